@@ -0,0 +1,302 @@
+// Query load generator for sizing a mdns_cpp::Service.
+//
+// Sends PTR/SRV/A questions with the unicast-response bit set to a responder (by default the
+// mdns_service example on this machine) and matches the unicast answers by query id.
+//
+//   mdns_bench [--target 127.0.0.1] [--port 5353] [--type ptr|srv|a] [--name NAME]
+//              [--rate QPS] [--window N] [--duration SECONDS] [--timeout MS]
+//
+// With --rate the queries go out on a fixed schedule no matter how the responder keeps up
+// (open loop). With --rate 0 at most --window queries are outstanding at any time (closed loop),
+// which measures the maximum throughput.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mdns_cpp/latency.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string target{"127.0.0.1"};
+    std::uint16_t port{5353};
+    std::uint16_t type{12};
+    std::string name;
+    double rate{1000.0};
+    std::uint32_t window{64};
+    double duration{10.0};
+    std::chrono::milliseconds timeout{1000};
+};
+
+// One line per power of two nanoseconds that has samples
+void PrintDistribution(std::ostream& os, const mdns_cpp::LatencyHistogram& histogram)
+{
+    using Histogram = mdns_cpp::LatencyHistogram;
+    const auto micros = [](std::chrono::nanoseconds ns) { return static_cast<double>(ns.count()) / 1000.0; };
+    for (std::size_t power = 0; power < Histogram::kPowers; ++power) {
+        std::uint64_t count = 0;
+        for (std::size_t sub = 0; sub < Histogram::kSubBuckets; ++sub) {
+            count += histogram.BucketCount(power * Histogram::kSubBuckets + sub);
+        }
+        if (count == 0) {
+            continue;
+        }
+        const std::chrono::nanoseconds low(power == 0 ? 0 : (std::uint64_t{1} << (power + Histogram::kSubBits - 1)));
+        const auto high = Histogram::BucketUpperBound(power * Histogram::kSubBuckets + Histogram::kSubBuckets - 1);
+        const auto bar = static_cast<std::size_t>(50.0 * static_cast<double>(count) / static_cast<double>(histogram.Count()));
+        os << "  " << std::setw(11) << micros(low) << " - " << std::setw(11) << micros(high) << " us "
+           << std::setw(10) << count << " " << std::string(bar, '#') << "\n";
+    }
+}
+
+// Query with a single question and the unicast-response bit (RFC 6762 5.4), so answers come
+// back to our port. Bytes 0-1 hold the query id
+std::vector<std::uint8_t> BuildQuery(const std::string& name, std::uint16_t type)
+{
+    std::vector<std::uint8_t> packet(12, 0);
+    packet[5] = 1; // one question
+    std::size_t start = 0;
+    while (start < name.size()) {
+        std::size_t end = name.find('.', start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        packet.push_back(static_cast<std::uint8_t>(end - start));
+        packet.insert(packet.end(), name.begin() + start, name.begin() + end);
+        start = end + 1;
+    }
+    packet.push_back(0);
+    packet.push_back(static_cast<std::uint8_t>(type >> 8));
+    packet.push_back(static_cast<std::uint8_t>(type));
+    packet.push_back(0x80); // QU + class IN
+    packet.push_back(0x01);
+    return packet;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--target") {
+            options.target = value;
+        } else if (arg == "--port") {
+            options.port = static_cast<std::uint16_t>(std::stoi(value));
+        } else if (arg == "--type") {
+            if (value == "ptr") {
+                options.type = 12;
+            } else if (value == "srv") {
+                options.type = 33;
+            } else if (value == "a") {
+                options.type = 1;
+            } else {
+                std::cerr << "Unknown query type " << value << "\n";
+                return false;
+            }
+        } else if (arg == "--name") {
+            options.name = value;
+        } else if (arg == "--rate") {
+            options.rate = std::stod(value);
+        } else if (arg == "--window") {
+            options.window = static_cast<std::uint32_t>(std::max(1, std::stoi(value)));
+        } else if (arg == "--duration") {
+            options.duration = std::stod(value);
+        } else if (arg == "--timeout") {
+            options.timeout = std::chrono::milliseconds(std::stoi(value));
+        } else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    if (options.name.empty()) {
+        // Matches the default ServiceSettings of mdns_service
+        switch (options.type) {
+            case 12: options.name = "_http._tcp.local."; break;
+            case 33: options.name = "myhost._http._tcp.local."; break;
+            default: options.name = "myhost.local."; break;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    struct sockaddr_in target{};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.target.c_str(), &target.sin_addr) != 1) {
+        std::cerr << "Invalid target address " << options.target << "\n";
+        return 1;
+    }
+
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        std::cerr << "Failed to open socket\n";
+        return 1;
+    }
+    // Room for bursts of answers while we are busy sending
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    auto query = BuildQuery(options.name, options.type);
+
+    // Send time per query id, the id space wraps long after a query has timed out
+    std::vector<Clock::time_point> sentAt(65536);
+    std::vector<bool> outstanding(65536, false);
+    // Set once a query has timed out, an answer still arriving for it counts as late
+    std::vector<bool> expired(65536, false);
+    // Ids in the order they were sent, to time out the oldest queries first
+    std::deque<std::pair<std::uint16_t, Clock::time_point>> sendOrder;
+    std::uint16_t nextId = 1;
+
+    mdns_cpp::LatencyHistogram histogram;
+    std::uint64_t sent = 0;
+    std::uint64_t answered = 0;
+    std::uint64_t late = 0;
+    std::uint64_t inFlight = 0;
+    std::uint64_t sendErrors = 0;
+
+    const auto interval = options.rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.rate)) : Clock::duration(0);
+    const auto start = Clock::now();
+    const auto sendEnd = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    const auto end = sendEnd + options.timeout;
+    auto nextSend = start;
+
+    std::cout << "Querying " << options.name << " (type " << options.type << ") at " << options.target << ":" << options.port << ", "
+              << (options.rate > 0 ? std::to_string(static_cast<long>(options.rate)) + " qps open loop" : std::to_string(options.window) + " outstanding closed loop")
+              << " for " << options.duration << "s\n";
+
+    std::array<std::uint8_t, 9000> buffer;
+    auto now = start;
+    while (now < end) {
+        // Give up on queries older than --timeout, or lost queries would hold on to the window
+        while (!sendOrder.empty() && now - sendOrder.front().second >= options.timeout) {
+            const auto [id, when] = sendOrder.front();
+            sendOrder.pop_front();
+            if (outstanding[id] && sentAt[id] == when) {
+                outstanding[id] = false;
+                expired[id] = true;
+                --inFlight;
+            }
+        }
+        // Send everything that is due
+        while (now < sendEnd) {
+            if (options.rate > 0 ? now < nextSend : inFlight >= options.window) {
+                break;
+            }
+            // A timed out query still holding this id counts as lost
+            if (outstanding[nextId]) {
+                outstanding[nextId] = false;
+                --inFlight;
+            }
+            query[0] = static_cast<std::uint8_t>(nextId >> 8);
+            query[1] = static_cast<std::uint8_t>(nextId);
+            sentAt[nextId] = now;
+            expired[nextId] = false;
+            if (sendto(sock, query.data(), query.size(), 0, reinterpret_cast<const struct sockaddr*>(&target), sizeof(target)) < 0) {
+                ++sendErrors;
+            } else {
+                outstanding[nextId] = true;
+                sendOrder.emplace_back(nextId, now);
+                ++inFlight;
+                ++sent;
+            }
+            nextId = static_cast<std::uint16_t>(nextId + 1);
+            if (nextId == 0) {
+                nextId = 1;
+            }
+            nextSend += interval;
+            now = Clock::now();
+        }
+
+        int waitMs = 1;
+        if (now >= sendEnd) {
+            waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count()) + 1;
+        } else if (options.rate > 0 && nextSend > now) {
+            waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(nextSend - now).count());
+        }
+        struct pollfd pfd{sock, POLLIN, 0};
+        if (poll(&pfd, 1, waitMs) > 0) {
+            // Drain everything that arrived
+            ssize_t received;
+            while ((received = recv(sock, buffer.data(), buffer.size(), MSG_DONTWAIT)) >= 12) {
+                const auto arrival = Clock::now();
+                const std::uint16_t id = static_cast<std::uint16_t>((buffer[0] << 8) | buffer[1]);
+                const bool response = (buffer[2] & 0x80) != 0;
+                const bool hasAnswers = ((buffer[6] << 8) | buffer[7]) != 0;
+                if (!response || !hasAnswers) {
+                    continue;
+                }
+                if (expired[id]) {
+                    expired[id] = false;
+                    ++late;
+                    continue;
+                }
+                if (!outstanding[id]) {
+                    continue;
+                }
+                outstanding[id] = false;
+                --inFlight;
+                const auto latency = arrival - sentAt[id];
+                if (latency > options.timeout) {
+                    ++late;
+                    continue;
+                }
+                ++answered;
+                histogram.Record(latency);
+            }
+        }
+        now = Clock::now();
+        if (now >= sendEnd && inFlight == 0) {
+            break;
+        }
+    }
+    close(sock);
+
+    const double seconds = std::chrono::duration<double>(std::min(now, sendEnd) - start).count();
+    const std::uint64_t lost = sent - answered;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Sent " << sent << " (" << static_cast<double>(sent) / seconds << " qps), answered " << answered << " ("
+              << static_cast<double>(answered) / seconds << " qps)\n";
+    std::cout << "Lost " << lost << " (" << (sent ? 100.0 * static_cast<double>(lost) / static_cast<double>(sent) : 0.0) << "%), of which "
+              << late << " answered after " << options.timeout.count() << "ms";
+    if (sendErrors) {
+        std::cout << ", " << sendErrors << " send errors";
+    }
+    std::cout << "\n";
+    std::cout << "Latency: " << histogram << "\n";
+    PrintDistribution(std::cout, histogram);
+
+    return answered > 0 ? 0 : 1;
+}
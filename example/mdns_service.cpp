@@ -9,7 +9,8 @@ int main()
 
     mdns_cpp::Service service(srv);
 
-    service.Start();
+    // Start() returns straight away, wait until the service is answering queries
+    service.Start().get();
     std::this_thread::sleep_for(std::chrono::seconds(2000));
     service.Stop();
     
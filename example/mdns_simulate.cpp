@@ -0,0 +1,75 @@
+// Discovery against a simulated link of many responders, no network needed.
+//
+//   mdns_simulate [--hosts N] [--loss FRACTION] [--seed N]
+//
+// Every responder runs a Service offering one _http._tcp instance. Prints how many instances one discovery round
+// found, the virtual and the real time it took, and the packet counts of the link.
+
+#include "mdns_cpp/service.hpp"
+#include "mdns_cpp/service_discovery.hpp"
+#include "mdns_cpp/simulated_network.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace
+{
+
+mdns_cpp::ServiceSettings SettingsOfHost(int index)
+{
+    mdns_cpp::ServiceSettings settings;
+    settings.service_name = "_http._tcp.local.";
+    settings.hostname = "node" + std::to_string(index);
+    settings.port = 8080;
+    settings.txt = mdns_cpp::TxtData{{"id", std::to_string(index)}};
+    return settings;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int hosts = 1000;
+    mdns_cpp::SimulatedNetworkSettings settings;
+    settings.jitter = std::chrono::microseconds(300);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg == "--hosts") {
+            hosts = std::atoi(argv[i + 1]);
+        } else if (arg == "--loss") {
+            settings.loss = std::atof(argv[i + 1]);
+        } else if (arg == "--seed") {
+            settings.seed = std::strtoull(argv[i + 1], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    mdns_cpp::SimulatedNetwork network(settings);
+    for (int i = 0; i < hosts; ++i) {
+        network.AddResponder(SettingsOfHost(i));
+    }
+
+    mdns_cpp::DiscoveryOptions options;
+    options.transport = network.AddHost();
+    options.instances = std::make_shared<mdns_cpp::InstanceTable>();
+    options.service_types = mdns_cpp::BrowseFilter({"_http._tcp.local."});
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto records = mdns_cpp::RunServiceDiscovery(options);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto stats = network.Stats();
+    std::cout << "Found " << options.instances->Size() << " of " << hosts << " instances from "
+              << records.size() << " records in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(network.Now().time_since_epoch()).count()
+              << " ms simulated, "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms real.\n"
+              << "Packets: " << stats.sent << " sent, " << stats.delivered << " delivered, " << stats.lost
+              << " lost.\n";
+    return 0;
+}
@@ -1,14 +1,39 @@
 #include "mdns_cpp/service_discovery.hpp"
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 
-int main()
+int main(int argc, char* argv[])
 {
-    const auto records = mdns_cpp::RunServiceDiscovery();
+    // --browse: keep watching the network and print changes as they happen
+    if (argc > 1 && std::string(argv[1]) == "--browse") {
+        mdns_cpp::ServiceBrowser browser;
+        browser.Subscribe([](const mdns_cpp::InstanceEvent& event) {
+            std::cout << event << "\n";
+        });
+        browser.Start();
+        std::this_thread::sleep_for(std::chrono::seconds(60));
+        browser.Stop();
+        return 0;
+    }
+
+    mdns_cpp::DiscoveryOptions options;
+    options.instances = std::make_shared<mdns_cpp::InstanceTable>();
+
+    const auto records = mdns_cpp::RunServiceDiscovery(options);
     std::cout << "Got " << records.size() << " records.\n";
     for (const auto& record : records) {
         std::cout << record << "\n";
     }
 
+    const auto instances = options.instances->Instances();
+    std::cout << "Found " << instances.size() << " service instances.\n";
+    for (const auto& instance : instances) {
+        std::cout << instance << "\n";
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mdns_cpp
+{
+
+// Set of service type patterns to browse for, see DiscoveryOptions::service_types.
+// A pattern is a service type name where
+//   "_http._tcp.local."                 matches exactly that type
+//   "_printer._sub._http._tcp.local."   matches that subtype
+//   "_ourco-*._tcp.local."              a label ending in '*' matches labels starting with the rest
+//   "*._tcp.local."                     a lone '*' matches any one label
+// Matching is case-insensitive. The patterns are compiled into a trie over the labels from right
+// to left, so matching a name walks it once no matter how many patterns there are, and never
+// allocates
+class BrowseFilter
+{
+public:
+    // An empty filter matches everything
+    BrowseFilter() = default;
+    BrowseFilter(std::initializer_list<std::string_view> patterns);
+
+    void Add(std::string_view pattern);
+    [[nodiscard]] bool Empty() const { return m_nodes.size() <= 1; }
+    // Whether all patterns are literal names, i.e. can be queried for directly
+    [[nodiscard]] bool Literal() const { return m_literal; }
+    [[nodiscard]] const std::vector<std::string>& Patterns() const { return m_patterns; }
+
+    // name is a service type or subtype, e.g. "_http._tcp.local."
+    [[nodiscard]] bool Matches(std::string_view name) const;
+
+private:
+    struct Node
+    {
+        // Lowercased labels and the node they lead to
+        std::vector<std::pair<std::string, std::uint32_t>> exact;
+        std::vector<std::pair<std::string, std::uint32_t>> prefix;
+        std::int32_t wildcard{-1};
+        bool terminal{false};
+    };
+
+    bool Match(std::uint32_t node, const std::string_view* labels, std::size_t count) const;
+
+    std::vector<Node> m_nodes{Node()};
+    std::vector<std::string> m_patterns;
+    bool m_literal{true};
+};
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct sockaddr;
+
+namespace mdns_cpp
+{
+
+// Selects the network interfaces mDNS sockets are opened on and answers are sent to.
+// Each pattern is one of
+//   an interface name, "eth0" or "eth0:1", or a name prefix ending in '*', "veth*". On Windows
+//   the adapter's friendly name, "Ethernet 2"
+//   an interface index, "3"
+//   a subnet, "192.168.1.0/24" or "fd00::/8", or a single address, "10.0.0.5"
+// An interface address is used if it matches an allow pattern (or allow is empty)
+// and no deny pattern
+struct InterfaceFilter
+{
+    std::vector<std::string> allow;
+    std::vector<std::string> deny;
+
+    [[nodiscard]] bool Empty() const { return allow.empty() && deny.empty(); }
+
+    // address is a struct sockaddr_in or sockaddr_in6 of the interface
+    [[nodiscard]] bool Matches(std::string_view interface_name, std::uint32_t interface_index, const struct sockaddr* address) const;
+};
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace mdns_cpp
+{
+
+// Log-linear histogram of durations: every power of two nanoseconds is split into 16 buckets,
+// so values are kept to within ~6%. Recording is lock-free and the histogram can be read from
+// any thread while it is being recorded to
+class LatencyHistogram
+{
+public:
+    static constexpr std::size_t kSubBits = 4;
+    static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBits;
+    // Up to 2^40ns, about 18 minutes, longer durations land in the last bucket
+    static constexpr std::size_t kPowers = 40 - kSubBits + 1;
+    static constexpr std::size_t kBuckets = kPowers * kSubBuckets;
+
+    void Record(std::chrono::nanoseconds duration);
+    void Reset();
+
+    [[nodiscard]] std::uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::chrono::nanoseconds Max() const { return std::chrono::nanoseconds(m_max.load(std::memory_order_relaxed)); }
+    [[nodiscard]] std::chrono::nanoseconds Mean() const;
+    // Upper bound of the bucket holding the percentile (0-100), 0 while empty
+    [[nodiscard]] std::chrono::nanoseconds Percentile(double percentile) const;
+
+    // Raw buckets, e.g. for exporting to a metrics system
+    [[nodiscard]] std::uint64_t BucketCount(std::size_t bucket) const { return m_buckets[bucket].load(std::memory_order_relaxed); }
+    [[nodiscard]] static std::chrono::nanoseconds BucketUpperBound(std::size_t bucket);
+
+private:
+    static std::size_t BucketIndex(std::uint64_t ns);
+
+    std::array<std::atomic<std::uint64_t>, kBuckets> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_sum{0};
+    std::atomic<std::uint64_t> m_max{0};
+};
+
+// "n=123 mean=12us p50=10us p99=40us p999=90us max=120us"
+std::ostream& operator<<(std::ostream& os, const LatencyHistogram& histogram);
+
+// Where the time goes between a query arriving and its answers leaving, see
+// ServiceSettings::latency_tracing. Queueing needs kernel receive timestamps (SO_TIMESTAMPNS),
+// only available on Linux
+struct ServiceLatency
+{
+    LatencyHistogram queueing; // kernel receive timestamp until the listen thread picks the packet up
+    LatencyHistogram parse;    // pickup until the first question reaches the responder
+    LatencyHistogram encode;   // building (and logging) the answers of a question, sends excluded
+    LatencyHistogram send;     // sendto() calls for the answers of a question
+    LatencyHistogram total;    // kernel receive timestamp (pickup without one) until the packet is handled
+};
+
+std::ostream& operator<<(std::ostream& os, const ServiceLatency& latency);
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mdns_cpp/types.hpp"
+
+namespace mdns_cpp
+{
+
+// Process-wide TTL cache of records seen on the network.
+// Filled by RunServiceDiscovery() and, with ServiceSettings::passive_cache, by every response a
+// running Service sees on its sockets. Lookups can then be answered without sending a query.
+// Thread safe
+class RecordCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static RecordCache& GetInstance();
+
+    // Inserts or refreshes a record. A TTL of 0 (goodbye) removes it.
+    // Questions and records of unknown type are ignored
+    void Insert(const Record& record);
+
+    // Unexpired records with this name and type, header.ttl is set to the remaining lifetime
+    [[nodiscard]] std::vector<Record> Find(const DomainName& name, RecordType type) const;
+    // Every unexpired record of this type, e.g. all PTR records to browse service types
+    [[nodiscard]] std::vector<Record> FindAll(RecordType type) const;
+    // As Find(), but only the records with more than half their TTL left, i.e. the known
+    // answers to list in a query for them (RFC 6762 7.1)
+    [[nodiscard]] std::vector<Record> KnownAnswers(const DomainName& name, RecordType type) const;
+
+    void PurgeExpired();
+    void Clear();
+    [[nodiscard]] std::size_t Size() const;
+
+    // Writes all unexpired records to <path> (through a temporary file and a rename, so readers
+    // never see a partial snapshot). Expiry times are stored as absolute wall clock times.
+    // Returns false if the file could not be written
+    bool SaveSnapshot(const std::string& path) const;
+    // Memory-maps a snapshot written by SaveSnapshot() and inserts every record that has not
+    // expired since. Loaded records are usable straight away but count as unconfirmed until the
+    // same record is seen on the network again. Returns the number of records loaded, 0 if the
+    // file is missing, from another snapshot version or corrupt
+    std::size_t LoadSnapshot(const std::string& path);
+    // Names and types that still have records loaded from a snapshot and not seen since,
+    // i.e. what to query for to confirm them
+    [[nodiscard]] std::vector<std::pair<DomainName, RecordType>> Unconfirmed() const;
+
+private:
+    RecordCache() = default;
+
+    // m_mutex must be held
+    void PurgeExpiredLocked(Clock::time_point now);
+
+    struct Key {
+        DomainName name;
+        std::uint16_t type;
+        bool operator==(const Key& other) const { return type == other.type && name == other.name; }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const { return key.name.Hash() ^ (static_cast<std::size_t>(key.type) << 1); }
+    };
+    struct Entry {
+        Record record;
+        Clock::time_point received;
+        Clock::time_point expiry;
+        // false for records loaded from a snapshot until seen on the network again
+        bool confirmed{true};
+    };
+
+    // Purge expired entries every this many inserts
+    static constexpr std::size_t kPurgeInterval = 256;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<Key, std::vector<Entry>, KeyHash> m_entries;
+    std::size_t m_insertsSincePurge{0};
+};
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+
+#include "mdns_cpp/types.hpp"
+
+namespace mdns_cpp
+{
+
+// Called for every record observed, see ServiceSettings::on_record and DiscoveryOptions::on_record
+using RecordCallback = std::function<void(const Record&)>;
+
+// What a full RecordQueue does with another record
+enum class OverflowPolicy {
+    DropNewest, // keep what is queued, the new record is dropped
+    DropOldest  // drop the oldest queued record to make room
+};
+
+// Bounded lock-free queue handing observed records from the socket threads to a thread of your own,
+// so a slow consumer never stalls receiving. Any number of threads may push and pop
+// (sequence-numbered ring after D. Vyukov). Push never blocks, records that do not fit are
+// dropped according to the OverflowPolicy and counted.
+//
+//   auto queue = std::make_shared<RecordQueue>(4096);
+//   settings.record_queue = queue;
+//   ...
+//   // consumer thread
+//   while (running) {
+//       if (queue->Drain([](const Record& record) { ... }) == 0) {
+//           std::this_thread::sleep_for(std::chrono::milliseconds(10));
+//       }
+//   }
+class RecordQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit RecordQueue(std::size_t capacity = 1024, OverflowPolicy policy = OverflowPolicy::DropNewest);
+    ~RecordQueue();
+
+    RecordQueue(const RecordQueue&) = delete;
+    RecordQueue& operator=(const RecordQueue&) = delete;
+
+    // false if the record (DropNewest) did not fit
+    bool Push(Record record);
+    std::optional<Record> Pop();
+
+    // Pops up to max records into fn, returns how many
+    template <typename Fn>
+    std::size_t Drain(Fn&& fn, std::size_t max = std::numeric_limits<std::size_t>::max())
+    {
+        std::size_t count = 0;
+        while (count < max) {
+            auto record = Pop();
+            if (!record) {
+                break;
+            }
+            fn(*record);
+            ++count;
+        }
+        return count;
+    }
+
+    [[nodiscard]] std::size_t Capacity() const { return m_mask + 1; }
+    // Only a snapshot while other threads push or pop
+    [[nodiscard]] std::size_t Size() const;
+    [[nodiscard]] bool Empty() const { return Size() == 0; }
+
+    // Records accepted and records dropped since construction
+    [[nodiscard]] std::uint64_t Pushed() const { return m_pushed.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    bool TryPush(Record& record);
+
+    struct Cell;
+
+    const OverflowPolicy m_policy;
+    std::size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    // Own cache lines, producers and consumers do not contend on each other's index
+    alignas(64) std::atomic<std::size_t> m_enqueuePos{0};
+    alignas(64) std::atomic<std::size_t> m_dequeuePos{0};
+    alignas(64) std::atomic<std::uint64_t> m_pushed{0};
+    std::atomic<std::uint64_t> m_dropped{0};
+};
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mdns_cpp/types.hpp"
+
+namespace mdns_cpp
+{
+
+// Records stored column by column, for result sets too large to keep as std::vector<Record>.
+// Every row has its type, class, TTL, owner name, section and sender in contiguous columns, and
+// an index into the payload column of its type (PTR targets, SRV data, addresses, ...).
+// Names and strings are interned, so a name shared by thousands of rows is stored once and rows
+// refer to it by a 32-bit id. Scanning one column, e.g. counting the rows of a type or collecting
+// the owners with a short TTL, touches a few bytes per row instead of a whole Record.
+//
+//   RecordTable table;
+//   RunServiceDiscovery(table);
+//   const auto& types = table.Types();
+//   for (std::size_t row = 0; row < table.Size(); ++row) {
+//       if (types[row] == static_cast<std::uint16_t>(RecordType::SRV)) {
+//           const auto& srv = table.Services()[table.Payloads()[row]];
+//           std::cout << table.Name(table.Names()[row]) << " -> " << table.Name(srv.target) << "\n";
+//       }
+//   }
+//
+// Not thread safe, Append() may reallocate every column.
+class RecordTable
+{
+public:
+    // Index into the interned names, see Name()
+    using NameId = std::uint32_t;
+    // Index into the interned strings (addresses), see String()
+    using StringId = std::uint32_t;
+    // Payload of a row without one, i.e. of a record type not listed below
+    static constexpr std::uint32_t kNoPayload = 0xFFFFFFFF;
+
+    struct Srv {
+        NameId target;
+        std::uint16_t priority;
+        std::uint16_t weight;
+        std::uint16_t port;
+    };
+    struct Hinfo {
+        std::string cpu;
+        std::string os;
+    };
+    struct Nsec {
+        NameId next_domain;
+        TypeBitmap types;
+    };
+
+    void Reserve(std::size_t rows);
+    void Append(const Record& record);
+    // Rows only, the interned names and strings are kept for the next rows
+    void Clear();
+
+    [[nodiscard]] std::size_t Size() const { return m_types.size(); }
+    [[nodiscard]] bool Empty() const { return m_types.empty(); }
+
+    // One entry per row
+    [[nodiscard]] const std::vector<std::uint16_t>& Types() const { return m_types; }
+    [[nodiscard]] const std::vector<std::uint16_t>& Classes() const { return m_classes; }
+    [[nodiscard]] const std::vector<std::uint32_t>& Ttls() const { return m_ttls; }
+    [[nodiscard]] const std::vector<NameId>& Names() const { return m_names; }
+    [[nodiscard]] const std::vector<EntryType>& Entries() const { return m_entries; }
+    [[nodiscard]] const std::vector<StringId>& Sources() const { return m_sources; }
+    [[nodiscard]] const std::vector<std::uint16_t>& Lengths() const { return m_lengths; }
+    // Index into the payload column of the row's type, kNoPayload if it has none
+    [[nodiscard]] const std::vector<std::uint32_t>& Payloads() const { return m_payloads; }
+
+    // Payload columns
+    [[nodiscard]] const std::vector<NameId>& PtrTargets() const { return m_ptrTargets; }
+    [[nodiscard]] const std::vector<Srv>& Services() const { return m_services; }
+    [[nodiscard]] const std::vector<StringId>& Ipv4Addresses() const { return m_ipv4Addresses; }
+    [[nodiscard]] const std::vector<StringId>& Ipv6Addresses() const { return m_ipv6Addresses; }
+    [[nodiscard]] const std::vector<TxtData>& Txts() const { return m_txts; }
+    [[nodiscard]] const std::vector<NameId>& CnameTargets() const { return m_cnameTargets; }
+    [[nodiscard]] const std::vector<Hinfo>& Hinfos() const { return m_hinfos; }
+    [[nodiscard]] const std::vector<Nsec>& Nsecs() const { return m_nsecs; }
+
+    // Names are interned as received, so At() gives them back spelled the same and names that
+    // only differ in case get an id each. FindName() ignores case and returns the first one interned
+    [[nodiscard]] std::string_view Name(NameId id) const;
+    [[nodiscard]] std::optional<NameId> FindName(std::string_view name) const;
+    [[nodiscard]] std::size_t NameCount() const;
+    [[nodiscard]] std::string_view String(StringId id) const;
+
+    // The rows of one type
+    [[nodiscard]] std::vector<std::size_t> Select(RecordType type) const;
+    [[nodiscard]] std::size_t Count(RecordType type) const;
+
+    // A row as a Record again
+    [[nodiscard]] Record At(std::size_t row) const;
+    [[nodiscard]] std::vector<Record> Records() const;
+
+private:
+    // Payload column of one record type: Append() stores the payload and returns its index,
+    // Get() builds the record back. Specialized per type in record_table.cpp
+    template <typename T>
+    struct Column;
+    // Dispatch over the Column<T> of every record type
+    struct Columns;
+
+    struct Span {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+    // Text kept in one buffer, looked up by hash. Ids stay valid as the buffer grows.
+    // The name pool is indexed by the case-insensitive DomainNameHash()
+    struct Pool {
+        std::string data;
+        std::vector<Span> spans;
+        std::unordered_multimap<std::size_t, std::uint32_t> index;
+
+        [[nodiscard]] std::string_view Get(std::uint32_t id) const;
+    };
+
+    NameId InternName(std::string_view name);
+    StringId InternString(std::string_view text);
+
+    std::vector<std::uint16_t> m_types;
+    std::vector<std::uint16_t> m_classes;
+    std::vector<std::uint32_t> m_ttls;
+    std::vector<NameId> m_names;
+    std::vector<EntryType> m_entries;
+    std::vector<StringId> m_sources;
+    std::vector<std::uint16_t> m_lengths;
+    std::vector<std::uint32_t> m_payloads;
+
+    std::vector<NameId> m_ptrTargets;
+    std::vector<Srv> m_services;
+    std::vector<StringId> m_ipv4Addresses;
+    std::vector<StringId> m_ipv6Addresses;
+    std::vector<TxtData> m_txts;
+    std::vector<NameId> m_cnameTargets;
+    std::vector<Hinfo> m_hinfos;
+    std::vector<Nsec> m_nsecs;
+
+    Pool m_namePool;
+    Pool m_stringPool;
+};
+
+}
@@ -1,17 +1,90 @@
 #pragma once
 
+#include <chrono>
+#include <future>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
+
+#include "mdns_cpp/interface_filter.hpp"
+#include "mdns_cpp/latency.hpp"
+#include "mdns_cpp/record_queue.hpp"
+#include "mdns_cpp/service_instance.hpp"
+#include "mdns_cpp/types.hpp"
 
 namespace mdns_cpp
 {
 
+// Answers questions for names a Service does not own itself, e.g. one process answering for
+// thousands of short-lived workload names without a Service (and a thread) for each.
+// Only asked about names other than the service type, instance, hostname and extra_records
+class AnswerProvider
+{
+public:
+    virtual ~AnswerProvider() = default;
+
+    // The records answering a <type> question (ANY for all types) for <name>, empty if there are
+    // none. An empty owner name in a record's header means <name>.
+    // Called on the listen thread, which waits for it. The result is cached: the next call for the
+    // same name and type comes once the shortest TTL of the records has run out (TTL 0 meaning
+    // the usual 120s/75min of RFC 6762 10), or after negative_answer_ttl for an empty result.
+    // An exception counts as an empty result
+    virtual std::vector<Record> Answer(const DomainName& name, RecordType type) = 0;
+};
+
 
-struct ServiceSettings 
+struct ServiceSettings
 {
     std::string service_name{"_http._tcp.local."};
-    std::string hostname{"myhost"}; 
+    std::string hostname{"myhost"};
     std::uint16_t port{5353};
+
+    // TXT key/values of the service instance
+    TxtData txt;
+    // Interfaces to answer on, by default every multicast capable non-loopback interface.
+    // Only read on Start()
+    InterfaceFilter interfaces;
+    // Largest packet sent, bigger answers are split over several packets.
+    // 0 picks it from the smallest interface MTU, at most 9000 (RFC 6762 17)
+    std::size_t max_packet_size{0};
+    // Put answers and announcements from other hosts seen on our sockets into RecordCache
+    bool passive_cache{false};
+    // File for RecordCache snapshots, empty disables them. Loaded on Start() so cached records are
+    // usable right away while queries confirm them, saved every cache_snapshot_interval and
+    // on Stop() (interval 0: only on Stop()). Turns on passive_cache
+    std::string cache_snapshot_path;
+    std::chrono::seconds cache_snapshot_interval{300};
+    // Query packets answered per second for each source address, 0 disables the limit. A packet
+    // costs the same however many questions it carries. A source may send query_burst packets
+    // at once, packets over the limit are dropped with all their questions.
+    // rate_limit_sources is how many sources are tracked before the least recently seen is evicted
+    double query_rate_limit{0};
+    std::uint32_t query_burst{32};
+    std::size_t rate_limit_sources{4096};
+    // Number of unsolicited announcements after startup, 1s apart and doubling (RFC 6762 8.3)
+    std::uint32_t announce_count{3};
+
+    // Record where the time goes when answering queries, see Service::Latency().
+    // Only read on Start()
+    bool latency_tracing{false};
+
+    // Every question and answer received on the service sockets. on_record runs on the listen
+    // thread and delays answering while it runs, record_queue hands records to a thread of your own
+    RecordCallback on_record;
+    std::shared_ptr<RecordQueue> record_queue;
+    // Service instances of other hosts, joined from the answers seen on the service sockets
+    std::shared_ptr<InstanceTable> instances;
+
+    // Additional records answered (by name and type) and announced next to the service records
+    std::vector<Record> extra_records;
+
+    // Answers for any other name, see AnswerProvider. Only read on Start()
+    std::shared_ptr<AnswerProvider> answer_provider;
+    // How long an empty answer from the provider is remembered
+    std::chrono::seconds negative_answer_ttl{5};
+    // Provider answers cached at most, expired ones are dropped first to make room
+    std::size_t answer_cache_size{4096};
 };
 
 
@@ -22,12 +95,35 @@ class Service
 public:
     Service(ServiceSettings settings = ServiceSettings());
     ~Service();
-    // Not thread safe, call this before Start()
+    // Replaces all settings. Safe to call at any time, but prefer the Update*() calls below on a
+    // running service since changing the service name or hostname re-announces everything
     void SetSettings(ServiceSettings settings);
 
-    void Start();
+    // Live updates. Thread safe and can be called while the service is running,
+    // only the records that actually changed are re-announced
+    void UpdateTxt(TxtData txt);
+    void SetTxtValue(std::string_view key, std::string_view value);
+    void RemoveTxtValue(std::string_view key);
+    void UpdatePort(std::uint16_t port);
+    // Adds a record to extra_records, replacing any existing record with the same name and type
+    void AddRecord(Record record);
+    // Removes extra records with this name and type, a goodbye is sent for them
+    void RemoveRecord(const DomainName& name, RecordType type);
+
+    // Returns immediately, interface enumeration, socket setup and the announcements run on the
+    // service thread. The future becomes ready once queries are being answered, or holds the
+    // exception if setup failed (e.g. no sockets could be opened)
+    std::shared_future<void> Start();
     void Stop();
     [[nodiscard]] bool Started() const;
+    // Forgets every cached answer of the answer_provider, e.g. after its names changed.
+    // Thread safe, takes effect before the next packet is handled
+    void FlushAnswers();
+    // Query packets dropped by the query_rate_limit since construction
+    [[nodiscard]] std::uint64_t ThrottledQueries() const;
+    // Latency histograms, only recorded to with ServiceSettings::latency_tracing.
+    // Safe to read while the service is running
+    [[nodiscard]] const ServiceLatency& Latency() const;
 
 private:
     class ServiceImpl;
@@ -36,4 +132,4 @@ private:
 
 
 
-}
\ No newline at end of file
+}
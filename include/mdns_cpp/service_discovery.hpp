@@ -1,16 +1,131 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
+#include "mdns_cpp/browse_filter.hpp"
+#include "mdns_cpp/interface_filter.hpp"
+#include "mdns_cpp/latency.hpp"
+#include "mdns_cpp/record_queue.hpp"
+#include "mdns_cpp/record_table.hpp"
+#include "mdns_cpp/service_instance.hpp"
+#include "mdns_cpp/transport.hpp"
 #include "mdns_cpp/types.hpp"
 
 namespace mdns_cpp
 {
 
+struct DiscoveryOptions
+{
+    // Interfaces queries are sent on, by default every multicast capable non-loopback interface
+    InterfaceFilter interfaces;
+    // Only keep records of these service types (and their hosts), by default everything.
+    // Other records are dropped before they are parsed
+    BrowseFilter service_types;
+    // Records as they arrive, before RunServiceDiscovery() returns them all.
+    // on_record runs on the receiving thread, record_queue hands them to a thread of your own
+    RecordCallback on_record;
+    std::shared_ptr<RecordQueue> record_queue;
+    // If set, the records received are joined into service instances here. Keep the table around
+    // between calls to follow the services on the network
+    std::shared_ptr<InstanceTable> instances;
+    // Ask responders to answer the first query straight back to us (QU, RFC 6762 5.4) instead of
+    // multicasting the answers to every host on the link. RunServiceDiscovery() sends from an
+    // ephemeral port and cannot hear multicast answers, so turning this off leaves it with the
+    // responders that reply to such ports anyway (RFC 6762 6.7)
+    bool unicast_response{true};
+    // Send and receive through this instead of the network, e.g. a SimulatedNetwork host. Used by
+    // RunServiceDiscovery(), RunQueries() and ResolveHost(), interfaces is ignored then. Nothing
+    // received through it goes into RecordCache, and ResolveHost() neither answers from nor fills
+    // its cache
+    std::shared_ptr<Transport> transport;
+    // If set, the time from sending the query to parsing each response is recorded here.
+    // Not used by ServiceBrowser, most of what it receives was never asked for
+    LatencyHistogram* response_latency{nullptr};
+};
+
 // DNS-SD
 // Note: might return repeated records
 // This function does take a while to run (1-2s)
-std::vector<Record> RunServiceDiscovery();
+std::vector<Record> RunServiceDiscovery(const DiscoveryOptions& options = DiscoveryOptions());
+// The same, appending the records to <table> instead, which is much more compact for thousands of
+// records. Returns the number of rows appended
+std::size_t RunServiceDiscovery(RecordTable& table, const DiscoveryOptions& options = DiscoveryOptions());
+
+enum class AddressFamily {
+    IPv4, // A record
+    IPv6  // AAAA record
+};
+
+// mDNS hostname lookup, e.g. "myhost.local."
+// Sends a single A/AAAA query and returns the address from the first matching answer,
+// or nullopt if nothing answered within the timeout.
+// Answers are cached for their TTL and failed lookups are cached for a short time,
+// so repeated calls for the same name do not touch the network.
+std::optional<std::string> ResolveHost(const std::string& hostname,
+                                       AddressFamily family = AddressFamily::IPv4,
+                                       std::chrono::milliseconds timeout = std::chrono::milliseconds(1000),
+                                       const DiscoveryOptions& options = DiscoveryOptions());
+
+// One question of RunQueries()
+struct Query
+{
+    DomainName name; // e.g. "My Printer._ipp._tcp.local."
+    RecordType type{RecordType::ANY};
+};
+
+// The answers to one Query, without duplicates
+struct QueryResult
+{
+    Query query;
+    std::vector<Record> answers;
+};
+
+// Asks many questions at once, e.g. SRV and TXT of every instance found by a browse. The
+// questions are packed into as few packets as the interface MTU allows, and the answers are
+// collected in one pass, each handed to every query it answers by name and type (ANY takes every
+// type). This includes answers the responder adds on its own, such as the A record of the host
+// next to an SRV record. Returns once every query has an answer, except that PTR and ANY queries
+// wait out the timeout since any number of hosts may answer them.
+// Results are in the order of <queries>, a query asked twice is only sent once
+std::vector<QueryResult> RunQueries(const std::vector<Query>& queries,
+                                    std::chrono::milliseconds timeout = std::chrono::milliseconds(1000),
+                                    const DiscoveryOptions& options = DiscoveryOptions());
+
+// Long-running DNS-SD browse, the alternative to calling RunServiceDiscovery() in a loop and
+// diffing the results. Listens on the mDNS port so announcements and goodbyes of other hosts are
+// heard as they happen, and repeats the browse query 1s, 2s, 4s, ... apart up to once an hour, or
+// once per the shortest TTL it has seen (RFC 6762 5.2), to catch responders that missed them.
+// The PTR, SRV, TXT and address records of the instances found are asked for again at 80%, 85%,
+// 90% and 95% of their TTL, so live instances do not expire. Only the first query for a type asks
+// for unicast answers, the repeats are answered by multicast so other hosts' caches benefit too.
+// Everything received is joined into an InstanceTable, Subscribe() to be told only about
+// instances that were added, changed or removed
+class ServiceBrowser
+{
+public:
+    // The records go into options.instances if set, else into a table of the browser's own
+    ServiceBrowser(DiscoveryOptions options = DiscoveryOptions());
+    ~ServiceBrowser();
+
+    // Opens the sockets and starts the browse thread. Throws std::runtime_error if no socket
+    // could be opened
+    void Start();
+    // The instances found stay in the table, where they expire unless refreshed by a restart
+    void Stop();
+    [[nodiscard]] bool Started() const;
+
+    [[nodiscard]] InstanceTable& Instances();
+    // Same as Instances().Subscribe(), callbacks run on the browse thread
+    InstanceTable::SubscriptionId Subscribe(InstanceCallback callback);
+    void Unsubscribe(InstanceTable::SubscriptionId id);
+
+private:
+    class BrowserImpl;
+    std::unique_ptr<BrowserImpl> m_impl;
+};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mdns_cpp/types.hpp"
+
+namespace mdns_cpp
+{
+
+// One DNS-SD service instance joined from its PTR, SRV, TXT and the A/AAAA records of its host
+struct ServiceInstance
+{
+    DomainName name;         // e.g. "My Printer._ipp._tcp.local."
+    DomainName service_type; // e.g. "_ipp._tcp.local."
+    // From the SRV record, empty/0 until it has been seen
+    DomainName hostname;
+    std::uint16_t port{0};
+    std::uint16_t priority{0};
+    std::uint16_t weight{0};
+    TxtData txt;
+    std::vector<std::string> ipv4_addresses;
+    std::vector<std::string> ipv6_addresses;
+
+    // Hostname, port and at least one address are known
+    [[nodiscard]] bool Resolved() const;
+};
+bool operator==(const ServiceInstance& lhs, const ServiceInstance& rhs);
+bool operator!=(const ServiceInstance& lhs, const ServiceInstance& rhs);
+std::ostream& operator<<(std::ostream& os, const ServiceInstance& instance);
+
+// A change to one instance of an InstanceTable
+struct InstanceEvent
+{
+    enum class Kind {
+        Added,   // first PTR or SRV record seen
+        Updated, // see changes
+        Removed  // goodbye or expiry of its last PTR/SRV record
+    };
+    // Bits of changes, for Updated
+    static constexpr std::uint8_t kServiceChanged = 1; // hostname, port, priority or weight
+    static constexpr std::uint8_t kTxtChanged = 2;
+    static constexpr std::uint8_t kAddressesChanged = 4;
+
+    Kind kind{Kind::Added};
+    std::uint8_t changes{0};
+    // After the change, the last known state for Removed
+    ServiceInstance instance;
+};
+std::string ToString(InstanceEvent::Kind kind);
+std::ostream& operator<<(std::ostream& os, const InstanceEvent& event);
+
+using InstanceCallback = std::function<void(const InstanceEvent&)>;
+
+// Service instances kept up to date from records as they arrive, so that the joined view never
+// needs a rescan of everything received. Instances are indexed by name (holding their SRV/TXT
+// data) and hosts by hostname (holding their addresses), each record updates one entry of either.
+// Records expire after their TTL and are removed by a goodbye (TTL 0).
+// Fill it through DiscoveryOptions::instances, ServiceSettings::instances or a ServiceBrowser, or
+// Insert() records yourself. Subscribe() to be told about changes instead of polling. Thread safe
+class InstanceTable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Applies a PTR, SRV, TXT, A or AAAA answer, anything else is ignored.
+    // Expected O(1) apart from the O(log n) expiry bookkeeping
+    void Insert(const Record& record);
+
+    // An instance with a PTR or SRV record that has not expired
+    [[nodiscard]] std::optional<ServiceInstance> Find(const DomainName& name) const;
+    [[nodiscard]] std::vector<ServiceInstance> Instances() const;
+    // Instances of one service type, e.g. "_http._tcp.local."
+    [[nodiscard]] std::vector<ServiceInstance> Instances(const DomainName& service_type) const;
+
+    // Drops expired records. Insert() does this as it goes, only needed to free memory when
+    // nothing arrives for a while
+    void PurgeExpired();
+    // Removes everything, subscribers get a Removed event for every instance
+    void Clear();
+    [[nodiscard]] std::size_t Size() const;
+
+    using SubscriptionId = std::uint64_t;
+    // Calls <callback> for every change from now on. Only instances whose joined view actually
+    // changed produce an event, an unchanged refresh produces none. Callbacks run on the thread
+    // that inserted the record or purged it (Insert(), PurgeExpired()), after the table is
+    // unlocked, so they may call back into it
+    SubscriptionId Subscribe(InstanceCallback callback);
+    void Unsubscribe(SubscriptionId id);
+
+private:
+    struct InstanceEntry {
+        ServiceInstance instance; // without addresses, those are joined in from the host
+        // Clock::time_point() when there is no such record
+        Clock::time_point ptr_expiry;
+        Clock::time_point srv_expiry;
+        Clock::time_point txt_expiry;
+    };
+    struct Address {
+        std::string address;
+        Clock::time_point received;
+        Clock::time_point expiry;
+    };
+    struct HostEntry {
+        std::vector<Address> ipv4;
+        std::vector<Address> ipv6;
+        // Instances whose SRV record points at this host
+        std::vector<DomainName> instances;
+    };
+    // Pending expiry of one record. Stale once the record was refreshed or removed, which is
+    // checked when it comes up
+    struct Expiry {
+        Clock::time_point when;
+        DomainName name;
+        std::uint16_t type;
+        std::string address; // A/AAAA only
+        bool operator>(const Expiry& other) const { return when > other.when; }
+    };
+
+    // m_mutex must be held for all of these
+    void InsertPtr(const DomainName& type, const DomainName& instance, Clock::time_point expiry);
+    void InsertSrv(const DomainName& instance, const ServiceRecord& record, Clock::time_point expiry);
+    void InsertTxt(const DomainName& instance, const TxtData& txt, Clock::time_point expiry);
+    void InsertAddress(const DomainName& host, bool ipv6, const std::string& address, bool cacheFlush, Clock::time_point now, Clock::time_point expiry);
+    void RemovePtr(const DomainName& instance);
+    void RemoveSrv(const DomainName& instance);
+    void RemoveTxt(const DomainName& instance);
+    void RemoveAddress(const DomainName& host, bool ipv6, const std::string& address);
+    void AttachHost(const DomainName& host, const DomainName& instance);
+    void DetachHost(const DomainName& host, const DomainName& instance);
+    void EraseInstanceIfUnused(const DomainName& instance);
+    void EraseHostIfUnused(const DomainName& host);
+    void Schedule(Clock::time_point when, const DomainName& name, std::uint16_t type, const std::string& address = std::string());
+    void PurgeExpiredLocked(Clock::time_point now, std::vector<InstanceEvent>& events);
+    ServiceInstance Join(const InstanceEntry& entry, Clock::time_point now) const;
+
+    // Change tracking, m_mutex must be held. An instance is there for subscribers from its first
+    // PTR/SRV record until the last one is removed, i.e. expiry is only seen once it is purged
+    struct Tracked {
+        DomainName name;
+        std::optional<ServiceInstance> before;
+    };
+    std::optional<ServiceInstance> Current(const DomainName& name) const;
+    // The instances a change to the record(s) of <name> can affect: the instance itself, or every
+    // instance on the host for A/AAAA records. Empty without subscribers
+    std::vector<Tracked> Track(const DomainName& name, bool host) const;
+    void Diff(const std::vector<Tracked>& tracked, std::vector<InstanceEvent>& events) const;
+    // Without m_mutex held
+    void Notify(const std::vector<InstanceEvent>& events) const;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<DomainName, InstanceEntry> m_instances;
+    std::unordered_map<DomainName, HostEntry> m_hosts;
+    std::unordered_map<DomainName, std::vector<DomainName>> m_types; // service type -> instances
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> m_expiries;
+    std::vector<std::pair<SubscriptionId, InstanceCallback>> m_subscribers;
+    SubscriptionId m_nextSubscription{1};
+};
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mdns_cpp/service.hpp"
+#include "mdns_cpp/transport.hpp"
+#include "mdns_cpp/types.hpp"
+
+namespace mdns_cpp
+{
+
+struct SimulatedNetworkSettings
+{
+    // One-way delay of every packet, plus a uniformly distributed 0..jitter on top
+    std::chrono::microseconds delay{500};
+    std::chrono::microseconds jitter{0};
+    // Chance of each packet being lost, per receiver for multicast
+    double loss{0.0};
+    // Same seed, same losses and delays
+    std::uint64_t seed{1};
+    std::size_t mtu{1500};
+};
+
+// A link of simulated hosts inside the process, to run discovery against thousands of responders
+// on a single machine without any network. Time is virtual: it only moves when a host waits for
+// packets, then jumps straight to the next delivery, so a simulated second costs no real time.
+// Driven from a single thread, the same calls give the same packets in the same order every run.
+// Thread safe, but waits from several threads make the order depend on scheduling.
+//
+//   SimulatedNetwork network;
+//   for (int i = 0; i < 1000; ++i) {
+//       network.AddResponder(SettingsOfHost(i));
+//   }
+//   DiscoveryOptions options;
+//   options.transport = network.AddHost();
+//   const auto records = RunServiceDiscovery(options);
+class SimulatedNetwork
+{
+public:
+    explicit SimulatedNetwork(SimulatedNetworkSettings settings = SimulatedNetworkSettings());
+    ~SimulatedNetwork();
+
+    SimulatedNetwork(const SimulatedNetwork&) = delete;
+    SimulatedNetwork& operator=(const SimulatedNetwork&) = delete;
+
+    // A new host on the link with an IPv4 address of its own, e.g. for DiscoveryOptions::transport.
+    // The network stays alive as long as any of its hosts
+    std::shared_ptr<Transport> AddHost();
+    // A host running a Service with <settings>, advertising the host's address. Queries are
+    // answered by the same code as a real Service, within the packet's delivery and without a
+    // thread. Announcements, interface filters, rate limiting, latency tracing and the passive
+    // RecordCache are not simulated. Returns the host's address
+    std::string AddResponder(const ServiceSettings& settings);
+
+    // Virtual time, starts at Transport::Clock::time_point()
+    [[nodiscard]] Transport::Clock::time_point Now() const;
+    // Moves time forward, delivering every packet that is due on the way
+    void Advance(std::chrono::microseconds duration);
+
+    struct Statistics
+    {
+        std::uint64_t sent{0};      // packets sent by any host
+        std::uint64_t delivered{0}; // packets received, a multicast counts once per receiver
+        std::uint64_t lost{0};      // packets dropped for SimulatedNetworkSettings::loss
+    };
+    [[nodiscard]] Statistics Stats() const;
+
+private:
+    class Impl;
+    std::shared_ptr<Impl> m_impl;
+};
+
+}
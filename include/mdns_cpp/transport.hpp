@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+struct sockaddr;
+struct sockaddr_storage;
+
+namespace mdns_cpp
+{
+
+// Where mDNS packets go. Without one, discovery uses sockets on the network interfaces through
+// the mdns library. Set DiscoveryOptions::transport to run it over something else instead, such
+// as a SimulatedNetwork. Endpoints are ints like sockets and packets hold the same bytes as on
+// the wire, so everything above this layer runs unchanged
+class Transport
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~Transport() = default;
+
+    // Opens the endpoints to send from and receive on. With <mdns_port> they are bound to port
+    // 5353 and receive what is multicast to the mDNS group, as a responder's. Otherwise to an
+    // ephemeral port that only receives unicast. Empty if nothing could be opened
+    virtual std::vector<int> Open(bool mdns_port) = 0;
+    virtual void Close(int endpoint) = 0;
+    // Sends to <address>, or to the mDNS multicast group if it is nullptr. 0 on success
+    virtual int Send(int endpoint, const void* data, std::size_t size, const struct sockaddr* address,
+                     std::size_t address_size) = 0;
+    // Those of <endpoints> with a packet waiting, blocks for up to <timeout> while there is none
+    virtual std::vector<int> Wait(const std::vector<int>& endpoints, std::chrono::microseconds timeout) = 0;
+    // Takes the next packet waiting on <endpoint>, returns its size (0 if there is none) and puts
+    // the sender into <from>
+    virtual std::size_t Receive(int endpoint, void* buffer, std::size_t capacity, struct sockaddr_storage& from,
+                                std::size_t& from_size) = 0;
+    // Timeouts of calls going through the transport are measured on this clock
+    [[nodiscard]] virtual Clock::time_point Now() const = 0;
+    // Largest packet to send
+    [[nodiscard]] virtual std::size_t MaxPacketSize() const = 0;
+};
+
+}
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <optional>
+#include <string_view>
 #include <vector>
 #include <utility>
 #include <variant>
@@ -18,6 +24,9 @@ enum class RecordType {
     TXT = 16, // Arbitrary text string
     A = 1, // Address
     AAAA = 28, // IP6 Address [Thomson]
+    CNAME = 5, // Canonical name for an alias
+    HINFO = 13, // Host information
+    NSEC = 47, // Next secure, lists the types that exist at a name [RFC4034]
     ANY = 255 // Any available records
 };
 
@@ -30,10 +39,73 @@ enum class EntryType {
 };
 std::string ToString(EntryType entry);
 
+// Case-insensitive compare/hash of two DNS names in dotted form
+bool DomainNameEquals(std::string_view lhs, std::string_view rhs);
+std::size_t DomainNameHash(std::string_view name);
+
+// A DNS name stored inline, e.g. "_http._tcp.local."
+// Names are at most 255 bytes on the wire so this never allocates; longer input is truncated.
+// Comparison and hashing are case-insensitive and ignore a trailing root dot.
+class DomainName {
+public:
+    static constexpr std::size_t kMaxLength = 255;
+
+    DomainName() = default;
+    DomainName(std::string_view name) { Assign(name); }
+    DomainName(const std::string& name) { Assign(name); }
+    DomainName(const char* name) { Assign(name); }
+
+    DomainName& operator=(std::string_view name) { Assign(name); return *this; }
+    DomainName& operator=(const std::string& name) { Assign(name); return *this; }
+    DomainName& operator=(const char* name) { Assign(name); return *this; }
+
+    void Assign(std::string_view name);
+    // Appends a suffix with a separating dot, e.g. DomainName("myhost").Append("local.")
+    DomainName& Append(std::string_view suffix);
+
+    [[nodiscard]] std::string_view view() const { return {m_data.data(), m_length}; }
+    operator std::string_view() const { return view(); }
+    [[nodiscard]] std::string str() const { return std::string(view()); }
+    [[nodiscard]] const char* data() const { return m_data.data(); }
+    [[nodiscard]] std::size_t size() const { return m_length; }
+    [[nodiscard]] bool empty() const { return m_length == 0; }
+    [[nodiscard]] char back() const { return m_data[m_length - 1]; }
+
+    [[nodiscard]] std::size_t LabelCount() const;
+    // Label <index> counted from the left, without dots
+    [[nodiscard]] std::string_view Label(std::size_t index) const;
+    // True if the last labels of this name equal suffix, e.g. "a._http._tcp.local." ends with "_tcp.local."
+    [[nodiscard]] bool EndsWith(std::string_view suffix) const;
+
+    [[nodiscard]] std::size_t Hash() const;
+
+    // Hidden friends so that plain string comparisons elsewhere in the namespace stay unambiguous
+    friend bool operator==(const DomainName& lhs, const DomainName& rhs) { return DomainNameEquals(lhs.view(), rhs.view()); }
+    friend bool operator!=(const DomainName& lhs, const DomainName& rhs) { return !(lhs == rhs); }
+    friend bool operator==(const DomainName& lhs, std::string_view rhs) { return DomainNameEquals(lhs.view(), rhs); }
+    friend bool operator==(std::string_view lhs, const DomainName& rhs) { return DomainNameEquals(lhs, rhs.view()); }
+    friend bool operator!=(const DomainName& lhs, std::string_view rhs) { return !(lhs == rhs); }
+    friend bool operator!=(std::string_view lhs, const DomainName& rhs) { return !(lhs == rhs); }
+    friend bool operator==(const DomainName& lhs, const std::string& rhs) { return DomainNameEquals(lhs.view(), rhs); }
+    friend bool operator==(const std::string& lhs, const DomainName& rhs) { return DomainNameEquals(lhs, rhs.view()); }
+    friend bool operator!=(const DomainName& lhs, const std::string& rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const std::string& lhs, const DomainName& rhs) { return !(lhs == rhs); }
+    friend bool operator==(const DomainName& lhs, const char* rhs) { return DomainNameEquals(lhs.view(), rhs); }
+    friend bool operator==(const char* lhs, const DomainName& rhs) { return DomainNameEquals(lhs, rhs.view()); }
+    friend bool operator!=(const DomainName& lhs, const char* rhs) { return !(lhs == rhs); }
+    friend bool operator!=(const char* lhs, const DomainName& rhs) { return !(lhs == rhs); }
+
+private:
+    std::array<char, kMaxLength> m_data;
+    std::uint8_t m_length{0};
+};
+
+std::ostream& operator<<(std::ostream& os, const DomainName& name);
+
 struct RecordHeader {
     std::string ip_address; // Possibly including port 
     EntryType entry_type{EntryType::UNKNOWN};
-    std::string entry_string; // example: "_services._dns-sd._udp.local."
+    DomainName entry_string; // example: "_services._dns-sd._udp.local."
 
     std::uint16_t record_type{255}; // Value may not be in RecordType!
     std::uint16_t rclass{0};
@@ -46,7 +118,7 @@ std::ostream& operator<<(std::ostream& os, const RecordHeader& header);
 struct DomainNamePointerRecord {
     RecordHeader header;
 
-    std::string name_string; // examples: "_http._tcp.local.", "_teamviewer._tcp.local."
+    DomainName name_string; // examples: "_http._tcp.local.", "_teamviewer._tcp.local."
 };
 bool operator==(const DomainNamePointerRecord& lhs, const DomainNamePointerRecord& rhs);
 std::ostream& operator<<(std::ostream& os, const DomainNamePointerRecord& record);
@@ -54,10 +126,10 @@ std::ostream& operator<<(std::ostream& os, const DomainNamePointerRecord& record
 struct ServiceRecord {
     RecordHeader header;
 
-    std::string service_name;
-    std::uint16_t priority;
-	std::uint16_t weight;
-	std::uint16_t port;
+    DomainName service_name;
+    std::uint16_t priority{0};
+    std::uint16_t weight{0};
+    std::uint16_t port{0};
 };
 bool operator==(const ServiceRecord& lhs, const ServiceRecord& rhs);
 std::ostream& operator<<(std::ostream& os, const ServiceRecord& record);
@@ -78,15 +150,158 @@ struct AAAARecord {
 bool operator==(const AAAARecord& lhs, const AAAARecord& rhs);
 std::ostream& operator<<(std::ostream& os, const AAAARecord& record);
 
+// TXT key/value strings stored in DNS wire format ("<len>key=value<len>key=value...")
+// in one contiguous buffer, with a small offset index on the side.
+// Lookups are case-insensitive on the key (RFC 6763 6.4) and iteration does not allocate.
+// A key without '=' is a boolean attribute, which is not the same as "key=" with an empty value
+class TxtData {
+public:
+    struct Entry {
+        std::string_view key;
+        std::string_view value;
+        bool has_value{false}; // false for a boolean "key", true for "key=" and "key=value"
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Entry;
+
+        const_iterator() = default;
+        const_iterator(const TxtData* data, std::size_t index) : m_data(data), m_index(index) {}
+
+        Entry operator*() const { return (*m_data)[m_index]; }
+        const_iterator& operator++() { ++m_index; return *this; }
+        const_iterator operator++(int) { auto copy = *this; ++m_index; return copy; }
+        const_iterator& operator--() { --m_index; return *this; }
+        const_iterator& operator+=(difference_type n) { m_index += n; return *this; }
+        const_iterator operator+(difference_type n) const { return {m_data, m_index + n}; }
+        difference_type operator-(const const_iterator& other) const { return static_cast<difference_type>(m_index) - static_cast<difference_type>(other.m_index); }
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        const TxtData* m_data{nullptr};
+        std::size_t m_index{0};
+    };
+
+    TxtData() = default;
+    TxtData(std::initializer_list<std::pair<std::string_view, std::string_view>> entries);
+
+    // Parses TXT record RDATA. Malformed trailing bytes are ignored
+    static TxtData FromWire(const void* data, std::size_t length);
+
+    // Reserve space for <count> entries totalling roughly <bytes> of key/value data
+    void Reserve(std::size_t count, std::size_t bytes);
+    // Appends a key/value string, a bare "key" for nullopt. Strings longer than 255 bytes are
+    // truncated as on the wire
+    void Add(std::string_view key, std::optional<std::string_view> value);
+    // Replaces the value of the first entry matching key, or appends a new entry.
+    // Every other entry is kept byte for byte
+    void Set(std::string_view key, std::optional<std::string_view> value);
+    // Removes all entries matching key, returns true if anything was removed
+    bool Remove(std::string_view key);
+    void Clear();
+
+    // The value of the first entry matching key, empty for both "key" and "key="
+    [[nodiscard]] std::optional<std::string_view> Find(std::string_view key) const;
+    // The first entry matching key, to tell a boolean "key" from "key="
+    [[nodiscard]] std::optional<Entry> FindEntry(std::string_view key) const;
+    [[nodiscard]] bool Contains(std::string_view key) const { return FindEntry(key).has_value(); }
+
+    [[nodiscard]] Entry operator[](std::size_t index) const;
+    [[nodiscard]] std::size_t size() const { return m_index.size(); }
+    [[nodiscard]] bool empty() const { return m_index.empty(); }
+    [[nodiscard]] const_iterator begin() const { return {this, 0}; }
+    [[nodiscard]] const_iterator end() const { return {this, m_index.size()}; }
+
+    // The whole TXT RDATA as it goes on the wire
+    [[nodiscard]] std::string_view Wire() const { return m_wire; }
+
+private:
+    struct Slot {
+        std::uint16_t offset; // of the length byte in m_wire
+        std::uint8_t key_length;
+        std::uint8_t value_length;
+        bool has_value; // there is a '=' after the key
+    };
+    static constexpr std::size_t kMaxWireSize = 0xFFFF;
+
+    void IndexString(std::size_t offset);
+    // Appends the wire string of entry <index> of <other> unchanged
+    void CopyString(const TxtData& other, std::size_t index);
+
+    std::string m_wire;
+    std::vector<Slot> m_index;
+};
+bool operator==(const TxtData& lhs, const TxtData& rhs);
+std::ostream& operator<<(std::ostream& os, const TxtData& txt);
+
 struct TXTRecord {
     RecordHeader header;
 
-    // Can keys be repeated? Should I just use an unordered_map?
-    std::vector<std::pair<std::string, std::string>> txt;
+    // Keys can be repeated on the wire, Find() returns the first one
+    TxtData txt;
 };
 bool operator==(const TXTRecord& lhs, const TXTRecord& rhs);
 std::ostream& operator<<(std::ostream& os, const TXTRecord& record);
 
+struct CNAMERecord {
+    RecordHeader header;
+
+    DomainName target; // The canonical name the owner is an alias for
+};
+bool operator==(const CNAMERecord& lhs, const CNAMERecord& rhs);
+std::ostream& operator<<(std::ostream& os, const CNAMERecord& record);
+
+struct HINFORecord {
+    RecordHeader header;
+
+    // Each at most 255 bytes on the wire, longer strings are truncated when sent
+    std::string cpu;
+    std::string os;
+};
+bool operator==(const HINFORecord& lhs, const HINFORecord& rhs);
+std::ostream& operator<<(std::ostream& os, const HINFORecord& record);
+
+// Set of record types, stored in the NSEC type bitmap wire format (RFC 4034 4.1.2):
+// per 256-type window a window number, a length and up to 32 bytes of bits
+class TypeBitmap {
+public:
+    TypeBitmap() = default;
+    TypeBitmap(std::initializer_list<std::uint16_t> types);
+
+    // Parses type bitmap RDATA. Malformed trailing bytes are ignored
+    static TypeBitmap FromWire(const void* data, std::size_t length);
+
+    void Add(std::uint16_t type);
+    [[nodiscard]] bool Contains(std::uint16_t type) const;
+    // The types in ascending order
+    [[nodiscard]] std::vector<std::uint16_t> Types() const;
+    [[nodiscard]] bool empty() const { return m_wire.empty(); }
+
+    [[nodiscard]] std::string_view Wire() const { return m_wire; }
+
+private:
+    std::string m_wire;
+};
+bool operator==(const TypeBitmap& lhs, const TypeBitmap& rhs);
+std::ostream& operator<<(std::ostream& os, const TypeBitmap& types);
+
+// mDNS uses NSEC to say which types exist at a name, so that a question for any other type has
+// a definite negative answer (RFC 6762 6.1). next_domain is normally the owner name itself
+struct NSECRecord {
+    RecordHeader header;
+
+    DomainName next_domain;
+    TypeBitmap types;
+};
+bool operator==(const NSECRecord& lhs, const NSECRecord& rhs);
+std::ostream& operator<<(std::ostream& os, const NSECRecord& record);
+
 struct AnyRecord {
     RecordHeader header;
 };
@@ -98,8 +313,23 @@ using Record = std::variant<DomainNamePointerRecord,
                             ARecord,
                             AAAARecord,
                             TXTRecord,
+                            CNAMERecord,
+                            HINFORecord,
+                            NSECRecord,
                             AnyRecord>;
 std::ostream& operator<<(std::ostream& os, const Record& record);
 
+// The header shared by all record types
+const RecordHeader& GetHeader(const Record& record);
+RecordHeader& GetHeader(Record& record);
+
 
-}
\ No newline at end of file
+}
+
+namespace std
+{
+template <>
+struct hash<mdns_cpp::DomainName> {
+    std::size_t operator()(const mdns_cpp::DomainName& name) const noexcept { return name.Hash(); }
+};
+}
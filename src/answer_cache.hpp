@@ -0,0 +1,165 @@
+#pragma once
+
+#include "mdns.h"
+#include "mdns_cpp/service.hpp"
+#include "ascii_case.hpp"
+#include "log.hpp"
+#include "packet_writer.hpp"
+#include "record_traits.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace mdns_cpp
+{
+
+// Results of a ServiceSettings::answer_provider, so that a name asked for over and over costs a
+// hash lookup instead of a call into the provider. Answers are kept for the shortest TTL of their
+// records, already converted for sending, and "no such records" for the negative TTL.
+// Not thread safe, owned by the listen thread
+class AnswerCache
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	AnswerCache(std::shared_ptr<AnswerProvider> provider, std::chrono::seconds negative_ttl, std::size_t capacity)
+	: m_provider(std::move(provider))
+	, m_negativeTtl(negative_ttl)
+	, m_capacity(std::max<std::size_t>(capacity, 1))
+	{
+	}
+
+	// The records answering a <rtype> question for <name>, empty if there are none.
+	// Valid until the next call
+	const std::vector<mdns_record_t>& Lookup(std::string_view name, std::uint16_t rtype)
+	{
+		MakeKey(name, rtype);
+		const auto now = Clock::now();
+		const auto it = m_entries.find(m_key);
+		if (it != m_entries.end()) {
+			if (now < it->second.expiry) {
+				return it->second.encoded;
+			}
+			m_entries.erase(it);
+		}
+
+		std::vector<Record> records;
+		try {
+			records = m_provider->Answer(DomainName(name), static_cast<RecordType>(rtype));
+		} catch (const std::exception& e) {
+			Log(LogLevel::Warn, fmt::format("Answer provider failed for {}: {}", name, e.what()));
+		}
+		if (m_entries.size() >= m_capacity) {
+			MakeRoom();
+		}
+
+		// Built in place, the encoded records point into the entry's records
+		Entry& entry = m_entries[m_key];
+		entry.records = std::move(records);
+		std::uint32_t ttl = std::numeric_limits<std::uint32_t>::max();
+		for (auto& record : entry.records) {
+			RecordHeader& header = GetHeader(record);
+			if (header.entry_string.empty()) {
+				header.entry_string = name;
+			}
+			header.record_type = RecordTypeOf(record);
+			ttl = std::min(ttl, header.ttl != 0 ? header.ttl : DefaultTtl(header.record_type));
+			const auto converted = Convert(record);
+			entry.encoded.insert(entry.encoded.end(), converted.begin(), converted.end());
+		}
+		entry.expiry = now + (entry.records.empty() ? m_negativeTtl : std::chrono::seconds(ttl));
+		Schedule(entry.expiry);
+		return entry.encoded;
+	}
+
+	void Clear()
+	{
+		m_entries.clear();
+		m_expiries = decltype(m_expiries)();
+	}
+
+	[[nodiscard]] std::size_t Size() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		std::vector<Record> records;
+		std::vector<mdns_record_t> encoded;
+		Clock::time_point expiry;
+	};
+	// Pending expiry of one entry. Stale once the entry was replaced or evicted, which is
+	// checked when it comes up, as in InstanceTable
+	struct Expiry {
+		Clock::time_point when;
+		std::string key;
+		bool operator>(const Expiry& other) const { return when > other.when; }
+	};
+
+	// The TTL PacketWriter sends a record with TTL 0 with
+	static std::uint32_t DefaultTtl(std::uint16_t rtype)
+	{
+		const bool host = (rtype == MDNS_RECORDTYPE_SRV) || (rtype == MDNS_RECORDTYPE_A) || (rtype == MDNS_RECORDTYPE_AAAA);
+		return host ? PacketWriter::kHostRecordTtl : PacketWriter::kOtherRecordTtl;
+	}
+
+	// Queues the expiry of the entry under m_key. Stale expiries only go when they come up, so
+	// the queue is rebuilt from the entries once they outnumber them
+	void Schedule(Clock::time_point when)
+	{
+		m_expiries.push({when, m_key});
+		if (m_expiries.size() > 2 * m_capacity) {
+			m_expiries = decltype(m_expiries)();
+			for (const auto& [key, entry] : m_entries) {
+				m_expiries.push({entry.expiry, key});
+			}
+		}
+	}
+
+	// Evicts the entry that expires first until there is room for one more, expired ones
+	// being the first to go
+	void MakeRoom()
+	{
+		while (m_entries.size() >= m_capacity && !m_expiries.empty()) {
+			const Expiry due = m_expiries.top();
+			m_expiries.pop();
+			const auto it = m_entries.find(due.key);
+			if (it != m_entries.end() && it->second.expiry == due.when) {
+				m_entries.erase(it);
+			}
+		}
+	}
+
+	// Lowercased name plus the record type, as HostCache does. Reuses m_key to not allocate
+	void MakeKey(std::string_view name, std::uint16_t rtype)
+	{
+		m_key.clear();
+		std::transform(name.begin(), name.end(), std::back_inserter(m_key), AsciiToLower);
+		if (!m_key.empty() && m_key.back() == '.') {
+			m_key.pop_back();
+		}
+		m_key += '/';
+		m_key += static_cast<char>(rtype & 0xFF);
+		m_key += static_cast<char>(rtype >> 8);
+	}
+
+	std::shared_ptr<AnswerProvider> m_provider;
+	std::chrono::seconds m_negativeTtl;
+	std::size_t m_capacity;
+	std::unordered_map<std::string, Entry> m_entries;
+	std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> m_expiries;
+	std::string m_key;
+};
+
+}
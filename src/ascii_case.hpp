@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MDNS_CPP_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define MDNS_CPP_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace mdns_cpp
+{
+
+// ASCII case folding for DNS names: only A-Z and a-z compare equal ignoring case (RFC 4343),
+// bytes outside ASCII are compared as they are. Works on dotted names and on wire-format names
+// alike since label length bytes are at most 63, below 'A'.
+// Names are folded 32 (AVX2), 16 (SSE2) or 8 (plain 64-bit arithmetic) bytes at a time, every
+// path produces the same results
+
+inline char AsciiToLower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+namespace detail
+{
+
+constexpr std::uint64_t kOnes = 0x0101010101010101ull;
+constexpr std::uint64_t kHighBits = 0x8080808080808080ull;
+
+// Lowercases the eight bytes of a word without branching: the high bit of a byte is set by the
+// additions exactly when it is in 'A'..'Z', and shifted down to 0x20
+inline std::uint64_t FoldWord(std::uint64_t word)
+{
+	const std::uint64_t low = word & ~kHighBits;
+	const std::uint64_t atLeastA = low + (0x80 - 'A') * kOnes;
+	const std::uint64_t aboveZ = low + (0x80 - 'Z' - 1) * kOnes;
+	const std::uint64_t upper = atLeastA & ~aboveZ & ~word & kHighBits;
+	return word | (upper >> 2);
+}
+
+inline std::uint64_t LoadWord(const char* data)
+{
+	std::uint64_t word;
+	std::memcpy(&word, data, sizeof(word));
+	return word;
+}
+
+// Less than eight bytes, zero padded
+inline std::uint64_t LoadTail(const char* data, std::size_t size)
+{
+	std::uint64_t word = 0;
+	std::memcpy(&word, data, size);
+	return word;
+}
+
+#ifdef MDNS_CPP_SSE2
+inline __m128i Fold16(__m128i bytes)
+{
+	// Moves 'A'..'Z' to the bottom of the signed range so one signed compare finds them
+	const __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+	const __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + 26)));
+	return _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+#ifdef MDNS_CPP_AVX2
+inline __m256i Fold32(__m256i bytes)
+{
+	const __m256i shifted = _mm256_add_epi8(bytes, _mm256_set1_epi8(static_cast<char>(0x80 - 'A')));
+	const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+	return _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+#endif
+
+inline std::uint64_t Mix(std::uint64_t hash, std::uint64_t word)
+{
+	hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+	return hash ^ (hash >> 29);
+}
+
+}
+
+inline bool AsciiEqualsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+	if (lhs.size() != rhs.size()) {
+		return false;
+	}
+	const char* a = lhs.data();
+	const char* b = rhs.data();
+	std::size_t size = lhs.size();
+#ifdef MDNS_CPP_AVX2
+	for (; size >= 32; size -= 32, a += 32, b += 32) {
+		const __m256i x = detail::Fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)));
+		const __m256i y = detail::Fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1) {
+			return false;
+		}
+	}
+#endif
+#ifdef MDNS_CPP_SSE2
+	for (; size >= 16; size -= 16, a += 16, b += 16) {
+		const __m128i x = detail::Fold16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+		const __m128i y = detail::Fold16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+			return false;
+		}
+	}
+#endif
+	for (; size >= 8; size -= 8, a += 8, b += 8) {
+		if (detail::FoldWord(detail::LoadWord(a)) != detail::FoldWord(detail::LoadWord(b))) {
+			return false;
+		}
+	}
+	return size == 0 || detail::FoldWord(detail::LoadTail(a, size)) == detail::FoldWord(detail::LoadTail(b, size));
+}
+
+// Hash of the lowercased bytes, taken a 64-bit word at a time
+inline std::uint64_t AsciiHashIgnoreCase(std::string_view str)
+{
+	const char* data = str.data();
+	std::size_t size = str.size();
+	std::uint64_t hash = 0x243F6A8885A308D3ull ^ size;
+#ifdef MDNS_CPP_SSE2
+	for (; size >= 16; size -= 16, data += 16) {
+		alignas(16) std::uint64_t words[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(words), detail::Fold16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))));
+		hash = detail::Mix(detail::Mix(hash, words[0]), words[1]);
+	}
+#endif
+	for (; size >= 8; size -= 8, data += 8) {
+		hash = detail::Mix(hash, detail::FoldWord(detail::LoadWord(data)));
+	}
+	if (size > 0) {
+		hash = detail::Mix(hash, detail::FoldWord(detail::LoadTail(data, size)));
+	}
+	hash ^= hash >> 32;
+	hash *= 0xD6E8FEB86659FD93ull;
+	return hash ^ (hash >> 32);
+}
+
+inline std::string AsciiLowercase(std::string_view str)
+{
+	std::string out(str);
+	for (auto& c : out) {
+		c = AsciiToLower(c);
+	}
+	return out;
+}
+
+}
@@ -0,0 +1,121 @@
+#include "mdns_cpp/browse_filter.hpp"
+#include "ascii_case.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// A name has at most 127 labels (RFC 1035 3.1)
+constexpr std::size_t kMaxLabels = 128;
+
+std::string_view TrimDots(std::string_view name)
+{
+    while (!name.empty() && name.back() == '.') {
+        name.remove_suffix(1);
+    }
+    return name;
+}
+
+// Splits a dotted name into labels, false if it has too many
+bool SplitLabels(std::string_view name, std::array<std::string_view, kMaxLabels>& labels, std::size_t& count)
+{
+    count = 0;
+    name = TrimDots(name);
+    while (!name.empty()) {
+        if (count == labels.size()) {
+            return false;
+        }
+        const auto dot = name.find('.');
+        labels[count++] = name.substr(0, dot);
+        name = (dot == std::string_view::npos) ? std::string_view() : name.substr(dot + 1);
+    }
+    return true;
+}
+
+}
+
+BrowseFilter::BrowseFilter(std::initializer_list<std::string_view> patterns)
+{
+    for (const auto pattern : patterns) {
+        Add(pattern);
+    }
+}
+
+void BrowseFilter::Add(std::string_view pattern)
+{
+    std::array<std::string_view, kMaxLabels> labels;
+    std::size_t count = 0;
+    if (!SplitLabels(pattern, labels, count) || count == 0) {
+        return;
+    }
+    m_patterns.emplace_back(pattern);
+
+    std::uint32_t node = 0;
+    for (std::size_t i = count; i-- > 0;) {
+        const auto label = labels[i];
+        std::uint32_t next = static_cast<std::uint32_t>(m_nodes.size());
+        if (label == "*") {
+            m_literal = false;
+            if (m_nodes[node].wildcard >= 0) {
+                next = static_cast<std::uint32_t>(m_nodes[node].wildcard);
+            } else {
+                m_nodes[node].wildcard = static_cast<std::int32_t>(next);
+                m_nodes.emplace_back();
+            }
+        } else {
+            const bool isPrefix = label.back() == '*';
+            m_literal = m_literal && !isPrefix;
+            const std::string key = AsciiLowercase(isPrefix ? label.substr(0, label.size() - 1) : label);
+            auto& edges = isPrefix ? m_nodes[node].prefix : m_nodes[node].exact;
+            const auto it = std::find_if(edges.begin(), edges.end(), [&key](const auto& edge) { return edge.first == key; });
+            if (it != edges.end()) {
+                next = it->second;
+            } else {
+                edges.emplace_back(key, next);
+                m_nodes.emplace_back();
+            }
+        }
+        node = next;
+    }
+    m_nodes[node].terminal = true;
+}
+
+bool BrowseFilter::Match(std::uint32_t node, const std::string_view* labels, std::size_t count) const
+{
+    const Node& current = m_nodes[node];
+    if (count == 0) {
+        return current.terminal;
+    }
+    const auto label = labels[count - 1];
+    for (const auto& [key, next] : current.exact) {
+        if (AsciiEqualsIgnoreCase(key, label) && Match(next, labels, count - 1)) {
+            return true;
+        }
+    }
+    for (const auto& [key, next] : current.prefix) {
+        if (label.size() >= key.size() && AsciiEqualsIgnoreCase(key, label.substr(0, key.size())) && Match(next, labels, count - 1)) {
+            return true;
+        }
+    }
+    return current.wildcard >= 0 && Match(static_cast<std::uint32_t>(current.wildcard), labels, count - 1);
+}
+
+bool BrowseFilter::Matches(std::string_view name) const
+{
+    if (Empty()) {
+        return true;
+    }
+    std::array<std::string_view, kMaxLabels> labels;
+    std::size_t count = 0;
+    if (!SplitLabels(name, labels, count)) {
+        return false;
+    }
+    return Match(0, labels.data(), count);
+}
+
+}
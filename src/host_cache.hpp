@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ascii_case.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace mdns_cpp
+{
+
+// Cache of hostname -> address lookups done by ResolveHost()
+// Positive results are kept for the TTL of the answer, negative results (timeouts) for a short fixed time
+class HostCache
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// How long a failed lookup is remembered before we query the network again
+	static constexpr std::chrono::seconds kNegativeTtl{2};
+
+	static HostCache& GetInstance() {
+		static HostCache instance;
+		return instance;
+	}
+
+	struct Entry {
+		std::optional<std::string> address; // nullopt for a negative entry
+		Clock::time_point expiry;
+	};
+
+	// Returns nullopt on a cache miss, or the cached entry (which may itself be negative)
+	std::optional<Entry> Find(std::string_view hostname, std::uint16_t rtype) {
+		const auto key = MakeKey(hostname, rtype);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto it = m_entries.find(key);
+		if (it == m_entries.end()) {
+			return std::nullopt;
+		}
+		if (it->second.expiry <= Clock::now()) {
+			m_entries.erase(it);
+			return std::nullopt;
+		}
+		return it->second;
+	}
+
+	void InsertPositive(std::string_view hostname, std::uint16_t rtype, std::string address, std::uint32_t ttl) {
+		if (ttl == 0) {
+			// Goodbye packet, drop whatever we had
+			Erase(hostname, rtype);
+			return;
+		}
+		Entry entry{std::move(address), Clock::now() + std::chrono::seconds(ttl)};
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[MakeKey(hostname, rtype)] = std::move(entry);
+	}
+
+	void InsertNegative(std::string_view hostname, std::uint16_t rtype) {
+		Entry entry{std::nullopt, Clock::now() + kNegativeTtl};
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[MakeKey(hostname, rtype)] = std::move(entry);
+	}
+
+	void Erase(std::string_view hostname, std::uint16_t rtype) {
+		const auto key = MakeKey(hostname, rtype);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.erase(key);
+	}
+
+	void Clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+	}
+
+private:
+	HostCache() = default;
+
+	// DNS names compare case-insensitively, so the key is the lowercased name plus the record type
+	static std::string MakeKey(std::string_view hostname, std::uint16_t rtype) {
+		std::string key;
+		key.reserve(hostname.size() + 3);
+		std::transform(hostname.begin(), hostname.end(), std::back_inserter(key), AsciiToLower);
+		key += '/';
+		key += static_cast<char>(rtype & 0xFF);
+		key += static_cast<char>(rtype >> 8);
+		return key;
+	}
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, Entry> m_entries;
+};
+
+}
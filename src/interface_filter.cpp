@@ -0,0 +1,119 @@
+#include "mdns_cpp/interface_filter.hpp"
+#include "interface_utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <Ws2tcpip.h>
+#include <iphlpapi.h>
+#else
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// Compares the first prefix_length bits
+bool PrefixEquals(const unsigned char* lhs, const unsigned char* rhs, unsigned int prefix_length)
+{
+    const unsigned int bytes = prefix_length / 8;
+    if (std::memcmp(lhs, rhs, bytes) != 0) {
+        return false;
+    }
+    const unsigned int bits = prefix_length % 8;
+    if (bits == 0) {
+        return true;
+    }
+    const unsigned char mask = static_cast<unsigned char>(0xff << (8 - bits));
+    return (lhs[bytes] & mask) == (rhs[bytes] & mask);
+}
+
+bool SubnetMatches(std::string_view pattern, const struct sockaddr* address)
+{
+    const auto slash = pattern.find('/');
+    const std::string host(pattern.substr(0, slash));
+    unsigned int prefixLength = 0;
+    if (slash != std::string_view::npos) {
+        const std::string prefix(pattern.substr(slash + 1));
+        if (prefix.empty() || !std::all_of(prefix.begin(), prefix.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            return false;
+        }
+        prefixLength = static_cast<unsigned int>(std::stoul(prefix));
+    }
+
+    if (address->sa_family == AF_INET) {
+        struct in_addr subnet;
+        if (inet_pton(AF_INET, host.c_str(), &subnet) != 1) {
+            return false;
+        }
+        const auto& addr = reinterpret_cast<const struct sockaddr_in*>(address)->sin_addr;
+        return PrefixEquals(reinterpret_cast<const unsigned char*>(&subnet), reinterpret_cast<const unsigned char*>(&addr),
+                            slash == std::string_view::npos ? 32 : std::min(prefixLength, 32u));
+    }
+    if (address->sa_family == AF_INET6) {
+        struct in6_addr subnet;
+        if (inet_pton(AF_INET6, host.c_str(), &subnet) != 1) {
+            return false;
+        }
+        const auto& addr = reinterpret_cast<const struct sockaddr_in6*>(address)->sin6_addr;
+        return PrefixEquals(reinterpret_cast<const unsigned char*>(&subnet), reinterpret_cast<const unsigned char*>(&addr),
+                            slash == std::string_view::npos ? 128 : std::min(prefixLength, 128u));
+    }
+    return false;
+}
+
+bool IsAddress(std::string_view pattern)
+{
+    const std::string host(pattern);
+    unsigned char buffer[sizeof(struct in6_addr)];
+    return inet_pton(AF_INET, host.c_str(), buffer) == 1 || inet_pton(AF_INET6, host.c_str(), buffer) == 1;
+}
+
+bool PatternMatches(std::string_view pattern, std::string_view interface_name, std::uint32_t interface_index, const struct sockaddr* address)
+{
+    if (pattern.empty()) {
+        return false;
+    }
+    if (std::all_of(pattern.begin(), pattern.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        return interface_index != 0 && std::to_string(interface_index) == pattern;
+    }
+    // Only a prefix length or an actual address makes a subnet, alias names such as "eth0:1"
+    // contain a ':' too
+    if (pattern.find('/') != std::string_view::npos || IsAddress(pattern)) {
+        return address && SubnetMatches(pattern, address);
+    }
+    if (pattern.back() == '*') {
+        const auto prefix = pattern.substr(0, pattern.size() - 1);
+        return interface_name.substr(0, prefix.size()) == prefix;
+    }
+    return interface_name == pattern;
+}
+
+}
+
+std::uint32_t InterfaceIndex(const std::string& interface_name)
+{
+    return static_cast<std::uint32_t>(if_nametoindex(interface_name.c_str()));
+}
+
+bool InterfaceFilter::Matches(std::string_view interface_name, std::uint32_t interface_index, const struct sockaddr* address) const
+{
+    const auto matches = [&](const std::string& pattern) {
+        return PatternMatches(pattern, interface_name, interface_index, address);
+    };
+    if (!allow.empty() && std::none_of(allow.begin(), allow.end(), matches)) {
+        return false;
+    }
+    return std::none_of(deny.begin(), deny.end(), matches);
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace mdns_cpp
+{
+
+// if_nametoindex(), kept out of mdns_utils.hpp since <net/if.h> clashes with its IFF_* definitions.
+// 0 if there is no such interface
+std::uint32_t InterfaceIndex(const std::string& interface_name);
+
+}
@@ -0,0 +1,119 @@
+#include "mdns_cpp/latency.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// Most readable unit for a duration
+struct Pretty
+{
+    std::chrono::nanoseconds value;
+};
+
+std::ostream& operator<<(std::ostream& os, Pretty pretty)
+{
+    const auto ns = pretty.value.count();
+    if (ns < 10000) {
+        return os << ns << "ns";
+    }
+    if (ns < 10000000) {
+        return os << ns / 1000 << "us";
+    }
+    return os << ns / 1000000 << "ms";
+}
+
+}
+
+std::size_t LatencyHistogram::BucketIndex(std::uint64_t ns)
+{
+    if (ns < kSubBuckets) {
+        return static_cast<std::size_t>(ns);
+    }
+    std::size_t msb = 63;
+    while (!(ns >> msb)) {
+        --msb;
+    }
+    const std::size_t power = msb - kSubBits + 1;
+    if (power >= kPowers) {
+        return kBuckets - 1;
+    }
+    const std::size_t sub = static_cast<std::size_t>(ns >> (power - 1)) & (kSubBuckets - 1);
+    return power * kSubBuckets + sub;
+}
+
+std::chrono::nanoseconds LatencyHistogram::BucketUpperBound(std::size_t bucket)
+{
+    const std::size_t power = bucket / kSubBuckets;
+    const std::uint64_t sub = bucket % kSubBuckets;
+    if (power == 0) {
+        return std::chrono::nanoseconds(sub);
+    }
+    return std::chrono::nanoseconds(((kSubBuckets + sub + 1) << (power - 1)) - 1);
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds duration)
+{
+    const std::uint64_t ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(0, duration.count()));
+    m_buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+    std::uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds LatencyHistogram::Mean() const
+{
+    const auto count = Count();
+    return std::chrono::nanoseconds(count ? m_sum.load(std::memory_order_relaxed) / count : 0);
+}
+
+std::chrono::nanoseconds LatencyHistogram::Percentile(double percentile) const
+{
+    const auto count = Count();
+    if (count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count))));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += BucketCount(i);
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), Max());
+        }
+    }
+    return Max();
+}
+
+std::ostream& operator<<(std::ostream& os, const LatencyHistogram& histogram)
+{
+    return os << "n=" << histogram.Count() << " mean=" << Pretty{histogram.Mean()} << " p50=" << Pretty{histogram.Percentile(50)}
+              << " p99=" << Pretty{histogram.Percentile(99)} << " p999=" << Pretty{histogram.Percentile(99.9)}
+              << " max=" << Pretty{histogram.Max()};
+}
+
+std::ostream& operator<<(std::ostream& os, const ServiceLatency& latency)
+{
+    return os << "queueing: " << latency.queueing << "\n"
+              << "parse:    " << latency.parse << "\n"
+              << "encode:   " << latency.encode << "\n"
+              << "send:     " << latency.send << "\n"
+              << "total:    " << latency.total;
+}
+
+}
@@ -1,11 +1,26 @@
 #pragma once
 
 #include "mdns.h"
+#include "mdns_cpp/interface_filter.hpp"
+#include "mdns_cpp/latency.hpp"
+#include "mdns_cpp/record_cache.hpp"
+#include "mdns_cpp/record_queue.hpp"
+#include "mdns_cpp/service_instance.hpp"
 #include "mdns_cpp/types.hpp"
 #include "types_utils.hpp"
-
+#include "record_traits.hpp"
+#include "packet_writer.hpp"
+#include "interface_utils.hpp"
+#include "rate_limiter.hpp"
+#include "answer_cache.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
 #include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <array>
 #include <memory>
 #include <vector>
@@ -76,6 +91,14 @@ enum
 # define IFF_DYNAMIC	IFF_DYNAMIC
 };
 
+// An interface address that passed the InterfaceFilter
+struct InterfaceAddress {
+	std::string name;
+	std::uint32_t index{0};
+	struct sockaddr_storage address;
+	std::uint8_t prefix_length{0};
+};
+
 struct service_t {
 	mdns_string_t service;
 	mdns_string_t hostname;
@@ -90,8 +113,58 @@ struct service_t {
 	mdns_record_t record_a;
 	mdns_record_t record_aaaa;
 	std::vector<mdns_record_t> records_txt;
+	// ServiceSettings::extra_records, answered when a question matches their name and type
+	std::vector<mdns_record_t> records_extra;
+	// Largest packet we send, answers that do not fit are split over several packets
+	size_t max_packet_size{kDefaultPacketSize};
+	// Feed answers seen on the service sockets into the RecordCache
+	bool passive_cache{false};
+	// Set when an InterfaceFilter is in use, packets from other interfaces are ignored
+	const std::vector<InterfaceAddress>* interfaces{nullptr};
+	// Observers of every question and answer received, either may be unset
+	const RecordCallback* on_record{nullptr};
+	RecordQueue* record_queue{nullptr};
+	// Joins the answers seen into service instances, may be unset
+	InstanceTable* instances{nullptr};
+};
+
+// Hands a received record to the service's observers
+inline void DeliverRecord(const service_t& service, Record record)
+{
+	if (service.on_record) {
+		(*service.on_record)(record);
+	}
+	if (service.record_queue) {
+		service.record_queue->Push(std::move(record));
+	}
+}
+
+// Timestamps of one received packet for ServiceLatency
+struct PacketTrace {
+	ServiceLatency* latency{nullptr};
+	// When the listen thread picked the packet up
+	std::chrono::steady_clock::time_point pickup;
+	// How long it sat in the socket buffer before that, if the kernel told us
+	std::optional<std::chrono::nanoseconds> queueing;
+	bool parsed{false};
+};
+
+// What ServiceCallback gets as user data, the service as seen from the arrival interface
+struct ListenContext {
+	const service_t* service{nullptr};
+	// The query was sent straight to one of our addresses, answer unicast (RFC 6762 5.5)
+	bool direct{false};
+	// Per-source limit on answered query packets, nullptr when disabled
+	RateLimiter* limiter{nullptr};
+	// Whether the limiter let the packet through, decided on its first question
+	std::optional<bool> admitted;
+	// Latency tracing of the packet being handled, nullptr when disabled
+	PacketTrace* trace{nullptr};
+	// Answers for names the service does not own, nullptr without an answer provider
+	AnswerCache* answers{nullptr};
 };
 
+
 inline mdns_cpp::EntryType ParseEntryType(mdns_entry_type old_entry_type) {
 	switch (old_entry_type) {
 		case MDNS_ENTRYTYPE_QUESTION : return EntryType::QUESTION;
@@ -102,49 +175,136 @@ inline mdns_cpp::EntryType ParseEntryType(mdns_entry_type old_entry_type) {
 	return EntryType::UNKNOWN;
 }
 
-inline std::string IPV4AddressToString(const sockaddr_in *addr, size_t addrlen) {
-  char host[NI_MAXHOST] = {0};
-  char service[NI_MAXSERV] = {0};
-  const int ret = getnameinfo((const struct sockaddr *)addr, (socklen_t)addrlen, host, NI_MAXHOST, service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
-  if (ret == 0) {
-    if (addr->sin_port != 0) {
-	  return fmt::format("{}:{}", host, service);
-    } else {
-	  return fmt::format("{}", host);
-    }
-  }
-  return "";
+struct OpenSocketsData {
+	std::vector<int> sockets;
+	struct sockaddr_in service_address_ipv4;
+	struct sockaddr_in6 service_address_ipv6;
+	// Smallest MTU of the interfaces enumerated, 0 if unknown
+	std::size_t mtu{0};
+	// Every interface address used, in enumeration order
+	std::vector<InterfaceAddress> interfaces;
+	// Whether an InterfaceFilter narrowed down the interfaces
+	bool filtered{false};
+	// Whether the sockets report the arrival interface of each packet, see PeekPacketInfo()
+	bool packet_info{false};
+};
+
+inline void AddInterface(OpenSocketsData& data, std::string name, std::uint32_t index, const struct sockaddr* address, std::uint8_t prefix_length)
+{
+	InterfaceAddress iface;
+	iface.name = std::move(name);
+	iface.index = index;
+	std::memset(&iface.address, 0, sizeof(iface.address));
+	std::memcpy(&iface.address, address, address->sa_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+	iface.prefix_length = prefix_length;
+	data.interfaces.push_back(std::move(iface));
 }
 
-inline std::string IPV6AddressToString(const sockaddr_in6 *addr, size_t addrlen) {
-  char host[NI_MAXHOST] = {0};
-  char service[NI_MAXSERV] = {0};
-  const int ret = getnameinfo((const struct sockaddr *)addr, (socklen_t)addrlen, host, NI_MAXHOST, service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
-  if (ret == 0) {
-    if (addr->sin6_port != 0) {
-	  return fmt::format("[{}]:{}", host, service);
-    } else {
-	  return fmt::format("{}", host);
-    }
-  }
-  return "";
+#ifdef _WIN32
+// The name Windows shows for an adapter, e.g. "Ethernet 2", in UTF-8. AdapterName is a GUID
+inline std::string AdapterFriendlyName(const IP_ADAPTER_ADDRESSES* adapter)
+{
+	const int size = adapter->FriendlyName ? WideCharToMultiByte(CP_UTF8, 0, adapter->FriendlyName, -1, nullptr, 0, nullptr, nullptr) : 0;
+	if (size <= 1) {
+		return adapter->AdapterName;
+	}
+	std::string name(static_cast<size_t>(size), '\0');
+	WideCharToMultiByte(CP_UTF8, 0, adapter->FriendlyName, -1, name.data(), size, nullptr, nullptr);
+	name.pop_back();
+	return name;
 }
+#endif
 
-inline std::string IPAddressToString(const sockaddr *addr, size_t addrlen) {
-  if (addr->sa_family == AF_INET6) {
-    return IPV6AddressToString((const struct sockaddr_in6 *)addr, addrlen);
-  }
-  return IPV4AddressToString((const struct sockaddr_in *)addr, addrlen);
+#ifndef _WIN32
+// Number of leading one bits of a netmask
+inline std::uint8_t PrefixLength(const struct sockaddr* netmask)
+{
+	if (!netmask) {
+		return 0;
+	}
+	const unsigned char* bytes = nullptr;
+	std::size_t size = 0;
+	if (netmask->sa_family == AF_INET6) {
+		bytes = reinterpret_cast<const struct sockaddr_in6*>(netmask)->sin6_addr.s6_addr;
+		size = 16;
+	} else {
+		// Not every platform sets sa_family on ifa_netmask, treat anything else as IPv4
+		bytes = reinterpret_cast<const unsigned char*>(&reinterpret_cast<const struct sockaddr_in*>(netmask)->sin_addr);
+		size = 4;
+	}
+	std::uint8_t length = 0;
+	for (std::size_t i = 0; i < size && bytes[i] != 0; ++i) {
+		for (unsigned char bit = 0x80; bit && (bytes[i] & bit); bit >>= 1) {
+			++length;
+		}
+	}
+	return length;
 }
+#endif
 
-struct OpenSocketsData {
-	std::vector<int> sockets;
-	struct sockaddr_in service_address_ipv4;
-	struct sockaddr_in6 service_address_ipv6;
-};
+// Whether a packet from <from> came from one of the interfaces in use. IPv6 link-local senders
+// are matched by scope id, everything else by subnet
+inline bool FromInterface(const struct sockaddr* from, const std::vector<InterfaceAddress>& interfaces)
+{
+	for (const auto& iface : interfaces) {
+		const auto* address = reinterpret_cast<const struct sockaddr*>(&iface.address);
+		if (from->sa_family != address->sa_family) {
+			continue;
+		}
+		const unsigned char* lhs = nullptr;
+		const unsigned char* rhs = nullptr;
+		std::size_t bits = iface.prefix_length;
+		if (from->sa_family == AF_INET) {
+			lhs = reinterpret_cast<const unsigned char*>(&reinterpret_cast<const struct sockaddr_in*>(from)->sin_addr);
+			rhs = reinterpret_cast<const unsigned char*>(&reinterpret_cast<const struct sockaddr_in*>(address)->sin_addr);
+		} else {
+			const auto* from6 = reinterpret_cast<const struct sockaddr_in6*>(from);
+			if (from6->sin6_scope_id) {
+				if (from6->sin6_scope_id == iface.index) {
+					return true;
+				}
+				continue;
+			}
+			lhs = from6->sin6_addr.s6_addr;
+			rhs = reinterpret_cast<const struct sockaddr_in6*>(address)->sin6_addr.s6_addr;
+		}
+		bool equal = true;
+		for (std::size_t i = 0; i < bits / 8 && equal; ++i) {
+			equal = lhs[i] == rhs[i];
+		}
+		if (equal && bits % 8) {
+			const unsigned char mask = static_cast<unsigned char>(0xff << (8 - bits % 8));
+			equal = (lhs[bits / 8] & mask) == (rhs[bits / 8] & mask);
+		}
+		if (equal) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Keeps the smallest non-zero MTU seen
+inline void UpdateMtu(OpenSocketsData& data, std::size_t mtu)
+{
+	if (mtu > 0 && (data.mtu == 0 || mtu < data.mtu)) {
+		data.mtu = mtu;
+	}
+}
+
+#ifdef __linux__
+inline std::size_t InterfaceMtu(const char* interface_name)
+{
+	// Not using SIOCGIFMTU, <net/if.h> clashes with the IFF_* definitions above
+	std::ifstream file(fmt::format("/sys/class/net/{}/mtu", interface_name));
+	std::size_t mtu = 0;
+	file >> mtu;
+	return mtu;
+}
+#endif
 
-inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64) {
+inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64, const InterfaceFilter& filter = InterfaceFilter()) {
     OpenSocketsData returnData;
+	returnData.filtered = !filter.Empty();
 	// When sending, each socket can only send to one network interface
 	// Thus we need to open one socket for each interface and address family
 
@@ -178,6 +338,8 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
 			continue;
 		if (adapter->OperStatus != IfOperStatusUp)
 			continue;
+		UpdateMtu(returnData, adapter->Mtu);
+		const std::string adapterName = AdapterFriendlyName(adapter);
 
 		for (IP_ADAPTER_UNICAST_ADDRESS* unicast = adapter->FirstUnicastAddress; unicast;
 		     unicast = unicast->Next) {
@@ -187,6 +349,10 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
 				    (saddr->sin_addr.S_un.S_un_b.s_b2 != 0) ||
 				    (saddr->sin_addr.S_un.S_un_b.s_b3 != 0) ||
 				    (saddr->sin_addr.S_un.S_un_b.s_b4 != 1)) {
+					if (!filter.Matches(adapterName, adapter->IfIndex, unicast->Address.lpSockaddr)) {
+						continue;
+					}
+					AddInterface(returnData, adapterName, adapter->IfIndex, unicast->Address.lpSockaddr, unicast->OnLinkPrefixLength);
 					if (first_ipv4) {
 						returnData.service_address_ipv4 = *saddr;
 						first_ipv4 = 0;
@@ -215,6 +381,10 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
 				if ((unicast->DadState == NldsPreferred) &&
 				    memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
 				    memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16)) {
+					if (!filter.Matches(adapterName, adapter->Ipv6IfIndex, unicast->Address.lpSockaddr)) {
+						continue;
+					}
+					AddInterface(returnData, adapterName, adapter->Ipv6IfIndex, unicast->Address.lpSockaddr, unicast->OnLinkPrefixLength);
 					if (first_ipv6) {
 						returnData.service_address_ipv6 = *saddr;
 						first_ipv6 = 0;
@@ -254,10 +424,19 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
 			continue;
 		if ((ifa->ifa_flags & IFF_LOOPBACK) || (ifa->ifa_flags & IFF_POINTOPOINT))
 			continue;
+		if (ifa->ifa_addr->sa_family != AF_INET && ifa->ifa_addr->sa_family != AF_INET6)
+			continue;
+		const std::uint32_t ifindex = InterfaceIndex(ifa->ifa_name);
+		if (!filter.Matches(ifa->ifa_name, ifindex, ifa->ifa_addr))
+			continue;
+#ifdef __linux__
+		UpdateMtu(returnData, InterfaceMtu(ifa->ifa_name));
+#endif
 
 		if (ifa->ifa_addr->sa_family == AF_INET) {
 			struct sockaddr_in* saddr = (struct sockaddr_in*)ifa->ifa_addr;
 			if (saddr->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+				AddInterface(returnData, ifa->ifa_name, ifindex, ifa->ifa_addr, PrefixLength(ifa->ifa_netmask));
 				if (first_ipv4) {
 					returnData.service_address_ipv4 = *saddr;
 					first_ipv4 = 0;
@@ -283,6 +462,7 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
 			                                                 0, 0, 0xff, 0xff, 0x7f, 0, 0, 1};
 			if (memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
 			    memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16)) {
+				AddInterface(returnData, ifa->ifa_name, ifindex, ifa->ifa_addr, PrefixLength(ifa->ifa_netmask));
 				if (first_ipv6) {
 					returnData.service_address_ipv6 = *saddr;
 					first_ipv6 = 0;
@@ -306,13 +486,187 @@ inline OpenSocketsData OpenClientSockets(int port, std::size_t max_sockets = 64)
     return returnData;
 }
 
-inline OpenSocketsData OpenServiceSockets() {
+// The wildcard service sockets join the mDNS group on the default interface only.
+// With an InterfaceFilter, join it on every selected interface instead and send from the first
+inline void JoinInterfaces(int sock, int family, const std::vector<InterfaceAddress>& interfaces)
+{
+	bool first = true;
+	for (const auto& iface : interfaces) {
+		if (iface.address.ss_family != family) {
+			continue;
+		}
+		if (family == AF_INET) {
+			struct ip_mreq req;
+			memset(&req, 0, sizeof(req));
+			req.imr_multiaddr.s_addr = htonl((((uint32_t)224U) << 24U) | ((uint32_t)251U));
+			req.imr_interface = reinterpret_cast<const struct sockaddr_in*>(&iface.address)->sin_addr;
+			// Fails harmlessly for the interface the socket already joined on
+			setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&req, sizeof(req));
+			if (first) {
+				setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&req.imr_interface, sizeof(req.imr_interface));
+			}
+		} else {
+			struct ipv6_mreq req;
+			memset(&req, 0, sizeof(req));
+			req.ipv6mr_multiaddr.s6_addr[0] = 0xFF;
+			req.ipv6mr_multiaddr.s6_addr[1] = 0x02;
+			req.ipv6mr_multiaddr.s6_addr[15] = 0xFB;
+			req.ipv6mr_interface = iface.index;
+			setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, (const char*)&req, sizeof(req));
+			if (first) {
+				const unsigned int index = iface.index;
+				setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (const char*)&index, sizeof(index));
+			}
+		}
+		first = false;
+	}
+}
+
+// Arrival interface and destination address of a received packet
+struct PacketInfo {
+	std::uint32_t interface_index{0};
+	struct sockaddr_storage destination;
+	bool valid{false};
+	// Kernel receive timestamp (SO_TIMESTAMPNS, CLOCK_REALTIME), 0 if not enabled
+	std::int64_t receive_time_ns{0};
+};
+
+// Asks for kernel receive timestamps on <sock>, see ServiceLatency. Linux only
+inline bool EnableReceiveTimestamps(int sock)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+	const int enable = 1;
+	return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0;
+#else
+	(void)sock;
+	return false;
+#endif
+}
+
+// CLOCK_REALTIME in nanoseconds, the clock receive timestamps are taken with
+inline std::int64_t RealtimeNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Asks for IP_PKTINFO / IPV6_PKTINFO control messages on received packets. Only on Linux,
+// elsewhere answers keep going out the default multicast interface
+inline bool EnablePacketInfo(int sock, int family)
+{
+#ifdef __linux__
+	const int enable = 1;
+	if (family == AF_INET) {
+		return setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &enable, sizeof(enable)) == 0;
+	}
+	return setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &enable, sizeof(enable)) == 0;
+#else
+	(void)sock;
+	(void)family;
+	return false;
+#endif
+}
+
+// Reads the packet info of the next packet on <sock> without consuming it,
+// mdns_socket_listen() then reads the packet itself
+inline PacketInfo PeekPacketInfo(int sock)
+{
+	PacketInfo info;
+	std::memset(&info.destination, 0, sizeof(info.destination));
+#ifdef __linux__
+	char byte;
+	struct iovec iov;
+	iov.iov_base = &byte;
+	iov.iov_len = sizeof(byte);
+	alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(struct in_pktinfo)) +
+	                                     CMSG_SPACE(sizeof(struct timespec))];
+	struct msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(sock, &msg, MSG_PEEK | MSG_DONTWAIT) < 0) {
+		return info;
+	}
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+			struct in_pktinfo pktinfo;
+			std::memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+			auto* destination = reinterpret_cast<struct sockaddr_in*>(&info.destination);
+			destination->sin_family = AF_INET;
+			destination->sin_addr = pktinfo.ipi_addr;
+			info.interface_index = static_cast<std::uint32_t>(pktinfo.ipi_ifindex);
+			info.valid = true;
+		} else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+			struct in6_pktinfo pktinfo;
+			std::memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+			auto* destination = reinterpret_cast<struct sockaddr_in6*>(&info.destination);
+			destination->sin6_family = AF_INET6;
+			destination->sin6_addr = pktinfo.ipi6_addr;
+			info.interface_index = static_cast<std::uint32_t>(pktinfo.ipi6_ifindex);
+			info.valid = true;
+		}
+#ifdef SO_TIMESTAMPNS
+		else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec timestamp;
+			std::memcpy(&timestamp, CMSG_DATA(cmsg), sizeof(timestamp));
+			info.receive_time_ns = static_cast<std::int64_t>(timestamp.tv_sec) * 1000000000 + timestamp.tv_nsec;
+		}
+#endif
+	}
+#else
+	(void)sock;
+#endif
+	return info;
+}
+
+// Whether the packet was sent to the mDNS group rather than directly to one of our addresses
+inline bool MulticastDestination(const PacketInfo& info)
+{
+	if (info.destination.ss_family == AF_INET) {
+		const auto* destination = reinterpret_cast<const struct sockaddr_in*>(&info.destination);
+		return (ntohl(destination->sin_addr.s_addr) >> 28) == 0xE;
+	}
+	if (info.destination.ss_family == AF_INET6) {
+		return reinterpret_cast<const struct sockaddr_in6*>(&info.destination)->sin6_addr.s6_addr[0] == 0xFF;
+	}
+	return true;
+}
+
+// Makes multicast sends on <sock> go out <iface>
+inline void SetMulticastInterface(int sock, const InterfaceAddress& iface)
+{
+	if (iface.address.ss_family == AF_INET) {
+		const auto& address = reinterpret_cast<const struct sockaddr_in*>(&iface.address)->sin_addr;
+		setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&address, sizeof(address));
+	} else {
+		const unsigned int index = iface.index;
+		setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (const char*)&index, sizeof(index));
+	}
+}
+
+inline int SocketFamily(int sock)
+{
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	if (getsockname(sock, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) {
+		return AF_UNSPEC;
+	}
+	return address.ss_family;
+}
+
+inline OpenSocketsData OpenServiceSockets(const InterfaceFilter& filter = InterfaceFilter()) {
 	// When receiving, each socket can receive data from all network interfaces
 	// Thus we only need to open one socket for each address family
 
 	// Call the client socket function to enumerate and get local addresses,
 	// but not open the actual sockets
-	auto openSocketData = OpenClientSockets(0, 0);
+	auto openSocketData = OpenClientSockets(0, 0, filter);
+	if (openSocketData.filtered && openSocketData.interfaces.empty()) {
+		Log(LogLevel::Warn, "No interface matches the interface filter");
+		return openSocketData;
+	}
+	openSocketData.packet_info = true;
 
 	/// IPv4
 	{
@@ -330,6 +684,10 @@ inline OpenSocketsData OpenServiceSockets() {
 #endif
 		int sock = mdns_socket_open_ipv4(&sock_addr);
 		if (sock >= 0) {
+			if (openSocketData.filtered) {
+				JoinInterfaces(sock, AF_INET, openSocketData.interfaces);
+			}
+			openSocketData.packet_info = EnablePacketInfo(sock, AF_INET) && openSocketData.packet_info;
 			openSocketData.sockets.push_back(sock);
 		}
 	}
@@ -346,6 +704,10 @@ inline OpenSocketsData OpenServiceSockets() {
 #endif
 		int sock = mdns_socket_open_ipv6(&sock_addr);
 		if (sock >= 0) {
+			if (openSocketData.filtered) {
+				JoinInterfaces(sock, AF_INET6, openSocketData.interfaces);
+			}
+			openSocketData.packet_info = EnablePacketInfo(sock, AF_INET6) && openSocketData.packet_info;
 			openSocketData.sockets.push_back(sock);
 		}
 	}
@@ -366,83 +728,145 @@ inline int QueryCallback(int sock, const struct sockaddr* from, size_t addrlen,
     char entrybuffer[256];
     // entrystr example: "_services._dns-sd._udp.local."
     const mdns_string_t entrystr = mdns_string_extract(data, size, &name_offset, entrybuffer, sizeof(entrybuffer));
-    header.entry_string = std::string(entrystr.str, entrystr.length);
+    header.entry_string = std::string_view(entrystr.str, entrystr.length);
 	header.record_type = rtype;
 	header.rclass = rclass;
 	header.ttl = ttl;
 	header.record_length = record_length;
 
-    if (rtype == MDNS_RECORDTYPE_PTR) {
-		auto domainPtrRecord = DomainNamePointerRecord();
-		domainPtrRecord.header = std::move(header);
-
-        char namebuffer[256];
-		const mdns_string_t namestr = mdns_record_parse_ptr(data, size, record_offset, record_length,
-		                                              namebuffer, sizeof(namebuffer));
+	if (entry == MDNS_ENTRYTYPE_QUESTION) {
+		// No RDATA, header.record_type holds the type asked for
+		auto question = AnyRecord();
+		question.header = std::move(header);
+		*recordOut = std::move(question);
+	} else {
+		ParseRecord(rtype, std::move(header), RDataView{data, size, record_offset, record_length}, *recordOut);
+	}
 
-		domainPtrRecord.name_string = std::string(namestr.str, namestr.length);
-		*recordOut = std::move(domainPtrRecord);
-	} else if (rtype == MDNS_RECORDTYPE_SRV) {
-		auto srvRecord = ServiceRecord();
-		srvRecord.header = std::move(header);
+    return 0;
+}   
 
-        char namebuffer[256];
-		const mdns_record_srv_t srv = mdns_record_parse_srv(data, size, record_offset, record_length,
-		                                              namebuffer, sizeof(namebuffer));
-		srvRecord.service_name = std::string(srv.name.str, srv.name.length);
 
-		*recordOut = std::move(srvRecord);
-	} else if (rtype == MDNS_RECORDTYPE_A) {
-		auto aRecord = ARecord();
-		aRecord.header = std::move(header);
+// DNS names are case-insensitive
+inline bool NameEquals(mdns_string_t lhs, std::string_view rhs)
+{
+	return DomainNameEquals(std::string_view(lhs.str, lhs.length), rhs);
+}
 
-		struct sockaddr_in addr;
-		mdns_record_parse_a(data, size, record_offset, record_length, &addr);
-		aRecord.address_string = IPV4AddressToString(&addr, sizeof(addr));
+inline bool NameEquals(mdns_string_t lhs, mdns_string_t rhs)
+{
+	return DomainNameEquals(std::string_view(lhs.str, lhs.length), std::string_view(rhs.str, rhs.length));
+}
 
-		*recordOut = std::move(aRecord);
-	} else if (rtype == MDNS_RECORDTYPE_AAAA) {
-		auto aaaaRecord = AAAARecord();
-		aaaaRecord.header = std::move(header);
+// State for a single A/AAAA lookup done by ResolveHost()
+struct HostQuery {
+	std::string_view hostname; // fully qualified, e.g. "myhost.local."
+	uint16_t rtype{MDNS_RECORDTYPE_A};
 
-		struct sockaddr_in6 addr;
-		mdns_record_parse_aaaa(data, size, record_offset, record_length, &addr);
-        aaaaRecord.address_string = IPV6AddressToString(&addr, sizeof(addr));
+	std::optional<std::string> address;
+	uint32_t ttl{0};
+};
 
-		*recordOut = std::move(aaaaRecord);
-	} else if (rtype == MDNS_RECORDTYPE_TXT) {
-		auto txtRecord = TXTRecord();
-		txtRecord.header = std::move(header);
+// Callback picking the first A/AAAA record matching a HostQuery out of a response
+inline int ResolveCallback(int sock, const struct sockaddr* from, size_t addrlen,
+                           mdns_entry_type_t entry, uint16_t query_id, uint16_t rtype,
+                           uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                           size_t name_offset, size_t name_length, size_t record_offset,
+                           size_t record_length, void* user_data)
+{
+	(void)sock;
+	(void)query_id;
+	(void)rclass;
+	(void)name_length;
+	auto query = reinterpret_cast<HostQuery*>(user_data);
+	// A goodbye (TTL 0) says the address is gone, it does not resolve the name
+	if (entry == MDNS_ENTRYTYPE_QUESTION || rtype != query->rtype || ttl == 0 || query->address) {
+		return 0;
+	}
 
-        mdns_record_txt_t txtbuffer[128];
-		const size_t parsed = mdns_record_parse_txt(data, size, record_offset, record_length, txtbuffer,
-		                                      sizeof(txtbuffer) / sizeof(mdns_record_txt_t));
-		for (size_t itxt = 0; itxt < parsed; ++itxt) {
-            const std::string key = std::string(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length);
-            const std::string value = std::string(txtbuffer[itxt].value.str, txtbuffer[itxt].value.length);
+	char namebuffer[256];
+	const mdns_string_t name = mdns_string_extract(data, size, &name_offset, namebuffer, sizeof(namebuffer));
+	if (!NameEquals(name, query->hostname)) {
+		return 0;
+	}
 
-			txtRecord.txt.emplace_back(key, value);
-		}
+	if (rtype == MDNS_RECORDTYPE_A) {
+		struct sockaddr_in addr;
+		mdns_record_parse_a(data, size, record_offset, record_length, &addr);
+		query->address = IPV4AddressToString(&addr, sizeof(addr));
 	} else {
-		auto anyRecord = AnyRecord();
-		anyRecord.header = std::move(header);
+		struct sockaddr_in6 addr;
+		mdns_record_parse_aaaa(data, size, record_offset, record_length, &addr);
+		query->address = IPV6AddressToString(&addr, sizeof(addr));
 	}
+	query->ttl = ttl;
+	Log(LogLevel::Debug, fmt::format("{} - Resolved {} to {} ttl {}", IPAddressToString(from, addrlen), query->hostname, *query->address, ttl));
+	return 0;
+}
 
-    return 0;
-}   
-
+// A query from another port than 5353 comes from a legacy unicast resolver (RFC 6762 6.7)
+inline bool LegacyQuerier(const struct sockaddr* from)
+{
+	if (from->sa_family == AF_INET) {
+		return ntohs(reinterpret_cast<const struct sockaddr_in*>(from)->sin_port) != MDNS_PORT;
+	}
+	if (from->sa_family == AF_INET6) {
+		return ntohs(reinterpret_cast<const struct sockaddr_in6*>(from)->sin6_port) != MDNS_PORT;
+	}
+	return false;
+}
 
 // Callback handling questions incoming on service sockets
 inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
                  uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
                  size_t size, size_t name_offset, size_t name_length, size_t record_offset,
                  size_t record_length, void* user_data) {
+	ListenContext* context = static_cast<ListenContext*>(user_data);
+	const service_t* service = context->service;
+	if (service->interfaces && !FromInterface(from, *service->interfaces)) {
+		return 0;
+	}
+	const bool observed = service->on_record || service->record_queue;
 	if (entry != MDNS_ENTRYTYPE_QUESTION) {
+		// Unsolicited answers and announcements from other hosts reach us anyway
+		if (service->passive_cache || observed || service->instances) {
+			Record record;
+			QueryCallback(sock, from, addrlen, entry, query_id, rtype, rclass, ttl, data, size, name_offset,
+			              name_length, record_offset, record_length, &record);
+			if (service->passive_cache) {
+				RecordCache::GetInstance().Insert(record);
+			}
+			if (service->instances) {
+				service->instances->Insert(record);
+			}
+			if (observed) {
+				DeliverRecord(*service, std::move(record));
+			}
+		}
 		return 0;
 	}
 
+	if (context->limiter) {
+		if (!context->admitted) {
+			context->admitted = context->limiter->Allow(from);
+		}
+		if (!*context->admitted) {
+			return 0;
+		}
+	}
+	PacketTrace* trace = context->trace;
+	if (trace && !trace->parsed) {
+		trace->parsed = true;
+		trace->latency->parse.Record(std::chrono::steady_clock::now() - trace->pickup);
+	}
+	if (observed) {
+		Record question;
+		QueryCallback(sock, from, addrlen, entry, query_id, rtype, rclass, ttl, data, size, name_offset,
+		              name_length, record_offset, record_length, &question);
+		DeliverRecord(*service, std::move(question));
+	}
+
 	const char dns_sd[] = "_services._dns-sd._udp.local.";
-	const service_t* service = (const service_t*)user_data;
 
 	const std::string fromaddrstr_cpp = IPAddressToString(from, addrlen);
 
@@ -450,65 +874,57 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 	size_t offset = name_offset;
 	mdns_string_t name = mdns_string_extract(data, size, &offset, namebuffer, sizeof(namebuffer));
 
-	std::string record_name;
-	mdns_record_type record_type;
-	if (rtype == MDNS_RECORDTYPE_PTR) {
-		record_name = "PTR";
-		record_type = MDNS_RECORDTYPE_PTR;
-	}
-	else if (rtype == MDNS_RECORDTYPE_SRV) {
-		record_name = "SRV";
-		record_type = MDNS_RECORDTYPE_SRV;
-	}
-	else if (rtype == MDNS_RECORDTYPE_A) {
-		record_name = "A";
-		record_type = MDNS_RECORDTYPE_A;
-	}
-	else if (rtype == MDNS_RECORDTYPE_AAAA) {
-		record_name = "AAAA";
-		record_type = MDNS_RECORDTYPE_AAAA;
-	}
-	else if (rtype == MDNS_RECORDTYPE_TXT) {
-		record_name = "TXT";
-		record_type = MDNS_RECORDTYPE_TXT;
+	// Nothing we answer has a type outside the table
+	const RecordTypeEntry* queried = FindRecordType(rtype);
+	if (!queried) {
+		return 0;
 	}
-	else if (rtype == MDNS_RECORDTYPE_ANY) {
-		record_name = "ANY";
-		record_type = MDNS_RECORDTYPE_ANY;
+	const auto record_type = static_cast<mdns_record_type>(rtype);
+
+	// Everything from here on is answering: encoding plus the sends timed by SendTimer
+	std::optional<SendTimer> sendTimer;
+	std::chrono::steady_clock::time_point answerStart;
+	if (trace) {
+		sendTimer.emplace();
+		answerStart = std::chrono::steady_clock::now();
 	}
-	else
-		return 0;
 
-	Log(LogLevel::Info, fmt::format("{} - Query {} {}", fromaddrstr_cpp, record_name, std::string(name.str, name.length)));
-
-	std::array<char, 1024> sendbuffer;
-	if ((name.length == (sizeof(dns_sd) - 1)) &&
-	    (strncmp(name.str, dns_sd, sizeof(dns_sd) - 1) == 0)) {
+	Log(LogLevel::Info, fmt::format("{} - Query {} {}", fromaddrstr_cpp, queried->name, std::string(name.str, name.length)));
+
+	// Sized for jumbo frames, max_packet_size limits how much of it is used
+	static thread_local std::array<char, kMaxPacketSize> sendbuffer_storage;
+	char* sendbuffer = sendbuffer_storage.data();
+	const size_t sendbuffer_size = std::min(service->max_packet_size, sendbuffer_storage.size());
+	// Queriers not on port 5353 are legacy resolvers that only hear answers sent straight back to
+	// them (RFC 6762 6.7), everyone else gets a unicast answer if asked for (QU) or if the query
+	// was sent to one of our addresses
+	const bool legacy = LegacyQuerier(from);
+	const bool unicast = (rclass & MDNS_UNICAST_RESPONSE) || context->direct || legacy;
+	// Whether the name is one of ours, whatever the type asked for
+	bool owned = true;
+	if (NameEquals(name, dns_sd)) {
 		if ((rtype == MDNS_RECORDTYPE_PTR) || (rtype == MDNS_RECORDTYPE_ANY)) {
 			// The PTR query was for the DNS-SD domain, send answer with a PTR record for the
 			// service name we advertise, typically on the "<_service-name>._tcp.local." format
 
 			// Answer PTR record reverse mapping "<_service-name>._tcp.local." to
 			// "<hostname>.<_service-name>._tcp.local."
-			mdns_record_t answer;
+			mdns_record_t answer{};
 			answer.name = name;
 			answer.type = MDNS_RECORDTYPE_PTR;
 			answer.data.ptr.name = service->service;
 
 			// Send the answer, unicast or multicast depending on flag in query
-			uint16_t unicast = (rclass & MDNS_UNICAST_RESPONSE);
 			Log(LogLevel::Info, fmt::format("  --> answer {} ({})", std::string(answer.data.ptr.name.str, answer.data.ptr.name.length), (unicast ? "unicast" : "multicast")));
 
 			if (unicast) {
-				mdns_query_answer_unicast(sock, from, addrlen, sendbuffer.data(), sendbuffer.size(),
-				                          query_id, record_type, name.str, name.length, answer, 0, 0, 0,
-				                          0);
+				AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+				              query_id, record_type, name.str, name.length, answer, nullptr, 0, legacy);
 			} else {
-				mdns_query_answer_multicast(sock, sendbuffer.data(), sendbuffer.size(), answer, 0, 0, 0, 0);
+				AnswerMulticast(sock, sendbuffer, sendbuffer_size, answer, nullptr, 0);
 			}
 		}
-	} else if ((name.length == service->service.length) &&
-	           (strncmp(name.str, service->service.str, name.length) == 0)) {
+	} else if (NameEquals(name, service->service)) {
 		if ((rtype == MDNS_RECORDTYPE_PTR) || (rtype == MDNS_RECORDTYPE_ANY)) {
 			// The PTR query was for our service (usually "<_service-name._tcp.local"), answer a PTR
 			// record reverse mapping the queried service name to our service instance name
@@ -538,20 +954,18 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 			additional.insert(additional.end(), service->records_txt.begin(), service->records_txt.end());
 
 			// Send the answer, unicast or multicast depending on flag in query
-			uint16_t unicast = (rclass & MDNS_UNICAST_RESPONSE);
 			Log(LogLevel::Info, fmt::format("  --> answer {} ({})", std::string(service->record_ptr.data.ptr.name.str, service->record_ptr.data.ptr.name.length), (unicast ? "unicast" : "multicast")));
 
 			if (unicast) {
-				mdns_query_answer_unicast(sock, from, addrlen, sendbuffer.data(), sendbuffer.size(),
-				                          query_id, record_type, name.str, name.length, answer, 0, 0,
-				                          additional.data(), additional.size());
+				AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+				              query_id, record_type, name.str, name.length, answer,
+				              additional.data(), additional.size(), legacy);
 			} else {
-				mdns_query_answer_multicast(sock, sendbuffer.data(), sendbuffer.size(), answer, 0, 0,
-				                            additional.data(), additional.size());
+				AnswerMulticast(sock, sendbuffer, sendbuffer_size, answer,
+				                additional.data(), additional.size());
 			}
 		}
-	} else if ((name.length == service->service_instance.length) &&
-	           (strncmp(name.str, service->service_instance.str, name.length) == 0)) {
+	} else if (NameEquals(name, service->service_instance)) {
 		if ((rtype == MDNS_RECORDTYPE_SRV) || (rtype == MDNS_RECORDTYPE_ANY)) {
 			// The SRV query was for our service instance (usually
 			// "<hostname>.<_service-name._tcp.local"), answer a SRV record mapping the service
@@ -576,20 +990,18 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 			additional.insert(additional.end(), service->records_txt.begin(), service->records_txt.end());
 
 			// Send the answer, unicast or multicast depending on flag in query
-			uint16_t unicast = (rclass & MDNS_UNICAST_RESPONSE);
 			Log(LogLevel::Info, fmt::format("  --> answer {} port {} ({})", std::string(service->record_srv.data.srv.name.str, service->record_srv.data.srv.name.length), service->port, (unicast ? "unicast" : "multicast")));
 
 			if (unicast) {
-				mdns_query_answer_unicast(sock, from, addrlen, sendbuffer.data(), sendbuffer.size(),
-				                          query_id, record_type, name.str, name.length, answer, 0, 0,
-				                          additional.data(), additional.size());
+				AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+				              query_id, record_type, name.str, name.length, answer,
+				              additional.data(), additional.size(), legacy);
 			} else {
-				mdns_query_answer_multicast(sock, sendbuffer.data(), sendbuffer.size(), answer, 0, 0,
-				                            additional.data(), additional.size());
+				AnswerMulticast(sock, sendbuffer, sendbuffer_size, answer,
+				                additional.data(), additional.size());
 			}
 		}
-	} else if ((name.length == service->hostname_qualified.length) &&
-	           (strncmp(name.str, service->hostname_qualified.str, name.length) == 0)) {
+	} else if (NameEquals(name, service->hostname_qualified)) {
 		if (((rtype == MDNS_RECORDTYPE_A) || (rtype == MDNS_RECORDTYPE_ANY)) &&
 		    (service->address_ipv4.sin_family == AF_INET)) {
 			// The A query was for our qualified hostname (typically "<hostname>.local.") and we
@@ -610,19 +1022,18 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 			additional.insert(additional.end(), service->records_txt.begin(), service->records_txt.end());
 
 			// Send the answer, unicast or multicast depending on flag in query
-			uint16_t unicast = (rclass & MDNS_UNICAST_RESPONSE);
 			std::string addrstr_cpp = IPAddressToString((struct sockaddr*)&service->record_a.data.a.addr,
 			    sizeof(service->record_a.data.a.addr));
 
 			Log(LogLevel::Info, fmt::format("  --> answer  {} IPv4 {} ({})", std::string(service->record_a.name.str, service->record_a.name.length), addrstr_cpp, (unicast ? "unicast" : "multicast")));
 
 			if (unicast) {
-				mdns_query_answer_unicast(sock, from, addrlen, sendbuffer.data(), sendbuffer.size(),
-				                          query_id, record_type, name.str, name.length, answer, 0, 0,
-				                          additional.data(), additional.size());
+				AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+				              query_id, record_type, name.str, name.length, answer,
+				              additional.data(), additional.size(), legacy);
 			} else {
-				mdns_query_answer_multicast(sock, sendbuffer.data(), sendbuffer.size(), answer, 0, 0,
-				                            additional.data(), additional.size());
+				AnswerMulticast(sock, sendbuffer, sendbuffer_size, answer,
+				                additional.data(), additional.size());
 			}
 		} else if (((rtype == MDNS_RECORDTYPE_AAAA) || (rtype == MDNS_RECORDTYPE_ANY)) &&
 		           (service->address_ipv6.sin6_family == AF_INET6)) {
@@ -644,7 +1055,6 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 			additional.insert(additional.end(), service->records_txt.begin(), service->records_txt.end());
 
 			// Send the answer, unicast or multicast depending on flag in query
-			uint16_t unicast = (rclass & MDNS_UNICAST_RESPONSE);
 
 			std::string addrstr_cpp = IPAddressToString((struct sockaddr*)&service->record_aaaa.data.aaaa.addr,
 			    sizeof(service->record_aaaa.data.aaaa.addr));
@@ -652,14 +1062,52 @@ inline int ServiceCallback(int sock, const struct sockaddr* from, size_t addrlen
 			Log(LogLevel::Info, fmt::format("  --> answer  {} IPv6 {} ({})", std::string(service->record_aaaa.name.str, service->record_aaaa.name.length), addrstr_cpp, (unicast ? "unicast" : "multicast")));
 
 			if (unicast) {
-				mdns_query_answer_unicast(sock, from, addrlen, sendbuffer.data(), sendbuffer.size(),
-				                          query_id, record_type, name.str, name.length, answer, 0, 0,
-				                          additional.data(), additional.size());
+				AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+				              query_id, record_type, name.str, name.length, answer,
+				              additional.data(), additional.size(), legacy);
 			} else {
-				mdns_query_answer_multicast(sock, sendbuffer.data(), sendbuffer.size(), answer, 0, 0,
-				                            additional.data(), additional.size());
+				AnswerMulticast(sock, sendbuffer, sendbuffer_size, answer,
+				                additional.data(), additional.size());
 			}
 		}
+	} else {
+		owned = false;
+	}
+
+	// Extra records are matched on their own name and type, independent of the service records above
+	for (const auto& extra : service->records_extra) {
+		if (!NameEquals(name, extra.name)) {
+			continue;
+		}
+		owned = true;
+		if ((rtype != extra.type) && (rtype != MDNS_RECORDTYPE_ANY)) {
+			continue;
+		}
+		Log(LogLevel::Info, fmt::format("  --> answer extra {} type {} ({})", std::string(extra.name.str, extra.name.length), static_cast<int>(extra.type), (unicast ? "unicast" : "multicast")));
+
+		if (unicast) {
+			AnswerUnicast(sock, from, addrlen, sendbuffer, sendbuffer_size,
+			              query_id, record_type, name.str, name.length, extra, nullptr, 0, legacy);
+		} else {
+			AnswerMulticast(sock, sendbuffer, sendbuffer_size, extra, nullptr, 0);
+		}
+	}
+
+	// Any other name is up to the answer provider, through its cache
+	if (!owned && context->answers) {
+		const auto& answers = context->answers->Lookup(std::string_view(name.str, name.length), rtype);
+		if (!answers.empty()) {
+			Log(LogLevel::Info, fmt::format("  --> answer {} provided record{} ({})", answers.size(), answers.size() == 1 ? "" : "s", (unicast ? "unicast" : "multicast")));
+
+			AnswerRecords(sock, unicast ? from : nullptr, unicast ? addrlen : 0, sendbuffer, sendbuffer_size,
+			              query_id, record_type, name.str, name.length, answers.data(), answers.size(), legacy);
+		}
+	}
+
+	if (trace && sendTimer->Packets() > 0) {
+		const auto elapsed = std::chrono::steady_clock::now() - answerStart;
+		trace->latency->send.Record(sendTimer->Elapsed());
+		trace->latency->encode.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) - sendTimer->Elapsed());
 	}
 	return 0;
 }
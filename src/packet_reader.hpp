@@ -0,0 +1,77 @@
+#pragma once
+
+#include "mdns.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mdns_cpp
+{
+
+// Calls <callback> for every question and resource record of a packet that is already in memory,
+// with the same arguments the mdns library's receive functions pass for a packet read from a
+// socket. For packets that come from a Transport. With <responses_only>, queries are ignored and
+// so are the questions of responses, as in mdns_discovery_recv()/mdns_query_recv().
+// Returns the number of resource records, stops at the first one that is cut off
+inline size_t ParsePacket(int sock, const struct sockaddr* from, size_t addrlen, const void* data, size_t size,
+                          mdns_record_callback_fn callback, void* user_data, bool responses_only)
+{
+	constexpr size_t kHeaderSize = 12;
+	if (size < kHeaderSize) {
+		return 0;
+	}
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	const auto read16 = [bytes](size_t offset) {
+		return static_cast<uint16_t>((bytes[offset] << 8) | bytes[offset + 1]);
+	};
+	const uint16_t query_id = read16(0);
+	const uint16_t flags = read16(2);
+	if (responses_only && !(flags & 0x8000)) {
+		return 0;
+	}
+
+	size_t offset = kHeaderSize;
+	const uint16_t questions = read16(4);
+	for (uint16_t i = 0; i < questions; ++i) {
+		const size_t name_offset = offset;
+		if (!mdns_string_skip(data, size, &offset) || offset + 4 > size) {
+			return 0;
+		}
+		const size_t name_length = offset - name_offset;
+		const uint16_t rtype = read16(offset);
+		const uint16_t rclass = read16(offset + 2);
+		offset += 4;
+		if (!responses_only) {
+			callback(sock, from, addrlen, MDNS_ENTRYTYPE_QUESTION, query_id, rtype, rclass, 0, data, size,
+			         name_offset, name_length, name_offset, name_length, user_data);
+		}
+	}
+
+	size_t records = 0;
+	const mdns_entry_type_t sections[] = {MDNS_ENTRYTYPE_ANSWER, MDNS_ENTRYTYPE_AUTHORITY, MDNS_ENTRYTYPE_ADDITIONAL};
+	for (size_t section = 0; section < 3; ++section) {
+		const uint16_t count = read16(6 + 2 * section);
+		for (uint16_t i = 0; i < count; ++i) {
+			const size_t name_offset = offset;
+			if (!mdns_string_skip(data, size, &offset) || offset + 10 > size) {
+				return records;
+			}
+			const size_t name_length = offset - name_offset;
+			const uint16_t rtype = read16(offset);
+			const uint16_t rclass = read16(offset + 2);
+			const uint32_t ttl = (static_cast<uint32_t>(read16(offset + 4)) << 16) | read16(offset + 6);
+			const uint16_t length = read16(offset + 8);
+			const size_t record_offset = offset + 10;
+			if (record_offset + length > size) {
+				return records;
+			}
+			callback(sock, from, addrlen, sections[section], query_id, rtype, rclass, ttl, data, size,
+			         name_offset, name_length, record_offset, length, user_data);
+			++records;
+			offset = record_offset + length;
+		}
+	}
+	return records;
+}
+
+}
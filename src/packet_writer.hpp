@@ -0,0 +1,629 @@
+#pragma once
+
+#include "mdns.h"
+#include "mdns_cpp/transport.hpp"
+#include "mdns_cpp/types.hpp"
+#include "ascii_case.hpp"
+#include "record_traits.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace mdns_cpp
+{
+
+// RFC 6762 17: mDNS packets can be up to 9000 bytes on jumbo-frame networks
+constexpr size_t kMaxPacketSize = 9000;
+// Used when the interface MTU is unknown: 1500 byte Ethernet MTU minus IPv6 and UDP headers
+constexpr size_t kDefaultPacketSize = 1452;
+// RFC 6762 6.7: answers to legacy unicast queries carry TTLs of at most 10 seconds
+constexpr uint32_t kLegacyUnicastTtl = 10;
+
+// Largest UDP payload that fits an interface MTU without IP fragmentation
+inline size_t PacketSizeForMtu(size_t mtu)
+{
+	if (mtu == 0) {
+		return kDefaultPacketSize;
+	}
+	// IPv6 + UDP headers, which also covers IPv4
+	constexpr size_t kHeaders = 40 + 8;
+	constexpr size_t kMinPacketSize = 512;
+	if (mtu < kMinPacketSize + kHeaders) {
+		return kMinPacketSize;
+	}
+	return std::min(mtu - kHeaders, kMaxPacketSize);
+}
+
+struct PacketOptions {
+	uint16_t query_id{0};
+	uint16_t flags{0x8400}; // QR + AA
+	// Set the cache-flush bit on unique records (everything except PTR), must be off for legacy unicast
+	bool cache_flush{true};
+	// Overrides every record TTL, e.g. 0 for goodbye packets
+	std::optional<uint32_t> ttl;
+	// Caps every record TTL, e.g. kLegacyUnicastTtl
+	std::optional<uint32_t> max_ttl;
+};
+
+// Encodes mDNS packets into a caller-provided buffer.
+// Unlike the mdns.h encoder (which only remembers 16 whole names), every suffix of every name
+// written is remembered, so "<hostname>.local." or "_http._tcp.local." only go on the wire once
+// per packet and later names point back at them (RFC 1035 4.1.4).
+class PacketWriter
+{
+public:
+	// Section order is fixed on the wire
+	enum class Section {
+		Question = 0,
+		Answer = 1,
+		Authority = 2,
+		Additional = 3
+	};
+
+	using Options = PacketOptions;
+
+	// RFC 6762 10: host name bearing records (SRV, A, AAAA) 120s, everything else 75 minutes.
+	// Only used for records whose ttl is 0
+	static constexpr uint32_t kHostRecordTtl = 120;
+	static constexpr uint32_t kOtherRecordTtl = 4500;
+
+	PacketWriter(void* buffer, size_t capacity, Options options = Options())
+	: m_buffer(static_cast<uint8_t*>(buffer))
+	, m_capacity(capacity)
+	, m_options(options)
+	{
+		m_suffixes.reserve(32);
+		Reset();
+	}
+
+	// Start over with an empty packet, keeping the options
+	void Reset() {
+		m_size = 0;
+		m_section = Section::Question;
+		m_suffixes.clear();
+		m_ok = (m_capacity >= kHeaderSize);
+		if (m_ok) {
+			std::memset(m_buffer, 0, kHeaderSize);
+			WriteU16At(0, m_options.query_id);
+			WriteU16At(2, m_options.flags);
+			m_size = kHeaderSize;
+		}
+	}
+
+	[[nodiscard]] const void* data() const { return m_buffer; }
+	[[nodiscard]] size_t size() const { return m_size; }
+	[[nodiscard]] size_t capacity() const { return m_capacity; }
+	[[nodiscard]] uint16_t Count(Section section) const { return ReadU16At(4 + 2 * static_cast<size_t>(section)); }
+	[[nodiscard]] bool Empty() const { return m_size <= kHeaderSize; }
+
+	bool AddQuestion(std::string_view name, uint16_t rtype, uint16_t rclass) {
+		if (!m_ok || m_section != Section::Question) {
+			return false;
+		}
+		const size_t mark = m_size;
+		if (!WriteName(name) || !WriteU16(rtype) || !WriteU16(rclass)) {
+			Rollback(mark);
+			return false;
+		}
+		IncrementCount(Section::Question);
+		return true;
+	}
+
+	// Returns false (and leaves the packet untouched) if the record does not fit.
+	// Sections must be added in wire order
+	bool AddRecord(Section section, const mdns_record_t& record) {
+		return AddRecords(section, &record, 1) == 1;
+	}
+
+	// Adds records until one does not fit, returns how many were consumed.
+	// Consecutive TXT records with the same name are merged into a single resource record
+	// holding all their key/value strings, the same way mdns.h does it
+	size_t AddRecords(Section section, const mdns_record_t* records, size_t count) {
+		if (!m_ok || section == Section::Question || section < m_section) {
+			return 0;
+		}
+		m_section = section;
+
+		size_t consumed = 0;
+		while (consumed < count) {
+			const mdns_record_t& record = records[consumed];
+			size_t group = 1;
+			if (record.type == MDNS_RECORDTYPE_TXT) {
+				while (consumed + group < count && records[consumed + group].type == MDNS_RECORDTYPE_TXT &&
+				       SameName(records[consumed + group].name, record.name)) {
+					++group;
+				}
+			}
+			if (!WriteRecord(records + consumed, group)) {
+				break;
+			}
+			IncrementCount(section);
+			consumed += group;
+		}
+		return consumed;
+	}
+
+	// Sets the TC bit, telling the receiver more known answers follow (RFC 6762 7.2)
+	void SetTruncated(bool truncated) {
+		uint16_t flags = ReadU16At(2);
+		flags = truncated ? (flags | 0x0200) : (flags & ~0x0200);
+		WriteU16At(2, flags);
+	}
+
+private:
+	// RecordTraits<T>::Write() writes RDATA with the Write* primitives below
+	template <typename T>
+	friend struct RecordTraits;
+
+	static constexpr size_t kHeaderSize = 12;
+	static constexpr size_t kMaxPointerOffset = 0x3FFF;
+	static constexpr int kMaxPointerJumps = 16;
+
+	struct Suffix {
+		uint32_t hash;
+		uint16_t offset;
+	};
+
+	static bool SameName(mdns_string_t lhs, mdns_string_t rhs) {
+		return DomainNameEquals(std::string_view(lhs.str, lhs.length), std::string_view(rhs.str, rhs.length));
+	}
+
+	static std::string_view TrimRootDot(std::string_view name) {
+		if (!name.empty() && name.back() == '.') {
+			name.remove_suffix(1);
+		}
+		return name;
+	}
+
+	static std::string_view NextLabel(std::string_view& name) {
+		const auto dot = name.find('.');
+		const auto label = name.substr(0, dot);
+		name = (dot == std::string_view::npos) ? std::string_view() : name.substr(dot + 1);
+		return label;
+	}
+
+	bool WriteRecord(const mdns_record_t* records, size_t count) {
+		const mdns_record_t& record = records[0];
+		const bool unique = (record.type != MDNS_RECORDTYPE_PTR);
+		uint16_t rclass = MDNS_CLASS_IN;
+		if (unique && m_options.cache_flush) {
+			rclass |= MDNS_CACHE_FLUSH;
+		}
+		uint32_t ttl = record.ttl;
+		if (m_options.ttl) {
+			ttl = *m_options.ttl;
+		} else if (ttl == 0) {
+			const bool host = (record.type == MDNS_RECORDTYPE_SRV || record.type == MDNS_RECORDTYPE_A ||
+			                   record.type == MDNS_RECORDTYPE_AAAA ||
+			                   static_cast<uint16_t>(record.type) == static_cast<uint16_t>(RecordType::HINFO));
+			ttl = host ? kHostRecordTtl : kOtherRecordTtl;
+		}
+		if (m_options.max_ttl) {
+			ttl = std::min(ttl, *m_options.max_ttl);
+		}
+
+		const size_t mark = m_size;
+		bool ok = WriteName(std::string_view(record.name.str, record.name.length)) &&
+		          WriteU16(static_cast<uint16_t>(record.type)) && WriteU16(rclass) && WriteU32(ttl) &&
+		          WriteU16(0);
+		const size_t rdata_start = m_size;
+		if (ok) {
+			static constexpr auto kWriters = MakeWriteTable<PacketWriter>(KnownRecordTypes());
+			// Types without traits are sent with empty RDATA
+			const auto type = static_cast<uint16_t>(record.type);
+			if (type < kWriters.size() && kWriters[type]) {
+				ok = kWriters[type](*this, records, count);
+			}
+		}
+		if (!ok || m_size - rdata_start > 0xFFFF) {
+			Rollback(mark);
+			return false;
+		}
+		WriteU16At(rdata_start - 2, static_cast<uint16_t>(m_size - rdata_start));
+		return true;
+	}
+
+	bool WriteCharacterString(mdns_string_t str) {
+		const size_t length = std::min<size_t>(str.length, 255);
+		return WriteU8(static_cast<uint8_t>(length)) && WriteBytes(str.str, length);
+	}
+
+	bool WriteName(std::string_view name) {
+		name = TrimRootDot(name);
+		while (!name.empty()) {
+			const auto hash = static_cast<uint32_t>(DomainNameHash(name));
+			if (const auto offset = FindSuffix(name, hash)) {
+				return WriteU16(static_cast<uint16_t>(0xC000 | *offset));
+			}
+			if (m_size <= kMaxPointerOffset) {
+				m_suffixes.push_back({hash, static_cast<uint16_t>(m_size)});
+			}
+			const auto label = NextLabel(name);
+			if (label.empty() || label.size() > 63) {
+				return false;
+			}
+			if (!WriteU8(static_cast<uint8_t>(label.size())) || !WriteBytes(label.data(), label.size())) {
+				return false;
+			}
+		}
+		return WriteU8(0);
+	}
+
+	std::optional<size_t> FindSuffix(std::string_view name, uint32_t hash) const {
+		for (const auto& suffix : m_suffixes) {
+			if (suffix.hash == hash && WireNameEquals(suffix.offset, name)) {
+				return suffix.offset;
+			}
+		}
+		return std::nullopt;
+	}
+
+	// Compares the (possibly compressed) name at offset in the packet with a dotted name
+	bool WireNameEquals(size_t offset, std::string_view name) const {
+		int jumps = 0;
+		while (offset < m_size) {
+			const uint8_t length = m_buffer[offset];
+			if ((length & 0xC0) == 0xC0) {
+				if (offset + 1 >= m_size || ++jumps > kMaxPointerJumps) {
+					return false;
+				}
+				offset = (static_cast<size_t>(length & 0x3F) << 8) | m_buffer[offset + 1];
+				continue;
+			}
+			if (length == 0) {
+				return name.empty();
+			}
+			if (name.empty() || offset + 1 + length > m_size) {
+				return false;
+			}
+			const auto label = NextLabel(name);
+			if (!AsciiEqualsIgnoreCase(label, std::string_view(reinterpret_cast<const char*>(m_buffer + offset + 1), length))) {
+				return false;
+			}
+			offset += 1 + length;
+		}
+		return false;
+	}
+
+	void Rollback(size_t mark) {
+		m_size = mark;
+		while (!m_suffixes.empty() && m_suffixes.back().offset >= mark) {
+			m_suffixes.pop_back();
+		}
+	}
+
+	void IncrementCount(Section section) {
+		const size_t offset = 4 + 2 * static_cast<size_t>(section);
+		WriteU16At(offset, static_cast<uint16_t>(ReadU16At(offset) + 1));
+	}
+
+	bool WriteBytes(const void* bytes, size_t length) {
+		if (m_size + length > m_capacity) {
+			return false;
+		}
+		std::memcpy(m_buffer + m_size, bytes, length);
+		m_size += length;
+		return true;
+	}
+
+	bool WriteU8(uint8_t value) {
+		return WriteBytes(&value, 1);
+	}
+
+	bool WriteU16(uint16_t value) {
+		const uint8_t bytes[2] = {static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+		return WriteBytes(bytes, 2);
+	}
+
+	bool WriteU32(uint32_t value) {
+		const uint8_t bytes[4] = {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+		                          static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+		return WriteBytes(bytes, 4);
+	}
+
+	void WriteU16At(size_t offset, uint16_t value) {
+		m_buffer[offset] = static_cast<uint8_t>(value >> 8);
+		m_buffer[offset + 1] = static_cast<uint8_t>(value);
+	}
+
+	uint16_t ReadU16At(size_t offset) const {
+		return static_cast<uint16_t>((m_buffer[offset] << 8) | m_buffer[offset + 1]);
+	}
+
+	uint8_t* m_buffer;
+	size_t m_capacity;
+	size_t m_size{0};
+	Options m_options;
+	Section m_section{Section::Question};
+	bool m_ok{false};
+	std::vector<Suffix> m_suffixes;
+};
+
+// Drop-in replacements for the mdns.h answer/announce/goodbye functions using PacketWriter.
+// Return 0 on success like mdns.h
+
+// Adds up the time spent sending packets on this thread while it is alive, for latency tracing
+class SendTimer
+{
+public:
+	SendTimer() : m_previous(Current()) { Current() = this; }
+	~SendTimer() { Current() = m_previous; }
+	SendTimer(const SendTimer&) = delete;
+	SendTimer& operator=(const SendTimer&) = delete;
+
+	[[nodiscard]] std::chrono::nanoseconds Elapsed() const { return m_elapsed; }
+	[[nodiscard]] size_t Packets() const { return m_packets; }
+
+	static SendTimer*& Current() {
+		static thread_local SendTimer* current = nullptr;
+		return current;
+	}
+
+	void Add(std::chrono::nanoseconds elapsed) {
+		m_elapsed += elapsed;
+		++m_packets;
+	}
+
+private:
+	SendTimer* m_previous;
+	std::chrono::nanoseconds m_elapsed{0};
+	size_t m_packets{0};
+};
+
+// Sends the packets of this thread through <transport> instead of the mdns library while it is
+// alive, <sock> then being one of the transport's endpoints. nullptr keeps the library
+class TransportScope
+{
+public:
+	explicit TransportScope(Transport* transport) : m_previous(Current()) { Current() = transport; }
+	~TransportScope() { Current() = m_previous; }
+	TransportScope(const TransportScope&) = delete;
+	TransportScope& operator=(const TransportScope&) = delete;
+
+	static Transport*& Current() {
+		static thread_local Transport* current = nullptr;
+		return current;
+	}
+
+private:
+	Transport* m_previous;
+};
+
+inline int SendPacketUntimed(int sock, const void* address, size_t address_size, const PacketWriter& writer)
+{
+	if (Transport* transport = TransportScope::Current()) {
+		return transport->Send(sock, writer.data(), writer.size(), static_cast<const struct sockaddr*>(address), address_size);
+	}
+	if (address) {
+		return mdns_unicast_send(sock, address, address_size, writer.data(), writer.size());
+	}
+	return mdns_multicast_send(sock, writer.data(), writer.size());
+}
+
+inline int SendPacket(int sock, const void* address, size_t address_size, const PacketWriter& writer)
+{
+	SendTimer* timer = SendTimer::Current();
+	if (!timer) {
+		return SendPacketUntimed(sock, address, address_size, writer);
+	}
+	const auto start = std::chrono::steady_clock::now();
+	const int ret = SendPacketUntimed(sock, address, address_size, writer);
+	timer->Add(std::chrono::steady_clock::now() - start);
+	return ret;
+}
+
+// Sends an answer with its additional records. Additional records that do not fit go out in
+// follow-up packets instead of being dropped. <question> is repeated in every packet if set
+inline int SendAnswer(int sock, const void* address, size_t address_size, void* buffer, size_t capacity,
+                      const PacketOptions& options, const mdns_string_t* question, uint16_t question_type,
+                      const mdns_record_t& answer, const mdns_record_t* additional, size_t additional_count)
+{
+	int ret = 0;
+	size_t sent = 0;
+	bool first = true;
+	do {
+		PacketWriter writer(buffer, capacity, options);
+		if (question && !writer.AddQuestion(std::string_view(question->str, question->length), question_type, MDNS_CLASS_IN)) {
+			return -1;
+		}
+		if (first && !writer.AddRecord(PacketWriter::Section::Answer, answer)) {
+			return -1;
+		}
+		const size_t added = writer.AddRecords(PacketWriter::Section::Additional, additional + sent, additional_count - sent);
+		if (!first && added == 0) {
+			// A single record larger than the buffer
+			return -1;
+		}
+		if (SendPacket(sock, address, address_size, writer) != 0) {
+			ret = -1;
+		}
+		sent += added;
+		first = false;
+	} while (sent < additional_count);
+	return ret;
+}
+
+// Options of a unicast answer. Only replies to legacy unicast queriers, i.e. queries not sent from
+// port 5353, lose the cache-flush bit and have their TTLs capped (RFC 6762 6.7, 10.2)
+inline PacketOptions UnicastOptions(uint16_t query_id, bool legacy)
+{
+	PacketOptions options;
+	options.query_id = query_id;
+	if (legacy) {
+		options.cache_flush = false;
+		options.max_ttl = kLegacyUnicastTtl;
+	}
+	return options;
+}
+
+inline int AnswerUnicast(int sock, const void* address, size_t address_size, void* buffer, size_t capacity,
+                         uint16_t query_id, mdns_record_type_t record_type, const char* name, size_t name_length,
+                         const mdns_record_t& answer, const mdns_record_t* additional, size_t additional_count,
+                         bool legacy)
+{
+	const PacketOptions options = UnicastOptions(query_id, legacy);
+	// Unicast answers repeat the question
+	const mdns_string_t question{name, name_length};
+	return SendAnswer(sock, address, address_size, buffer, capacity, options, &question, record_type,
+	                  answer, additional, additional_count);
+}
+
+inline int AnswerMulticast(int sock, void* buffer, size_t capacity, const mdns_record_t& answer,
+                           const mdns_record_t* additional, size_t additional_count,
+                           PacketOptions options = PacketOptions())
+{
+	return SendAnswer(sock, nullptr, 0, buffer, capacity, options, nullptr, 0, answer, additional, additional_count);
+}
+
+// Sends several records as the answers to one question, using as many packets as needed.
+// With an address they go unicast and repeat the question, as in AnswerUnicast()
+inline int AnswerRecords(int sock, const void* address, size_t address_size, void* buffer, size_t capacity,
+                         uint16_t query_id, mdns_record_type_t record_type, const char* name, size_t name_length,
+                         const mdns_record_t* records, size_t count, bool legacy)
+{
+	const PacketOptions options = address ? UnicastOptions(query_id, legacy) : PacketOptions();
+	int ret = 0;
+	size_t sent = 0;
+	while (sent < count) {
+		PacketWriter writer(buffer, capacity, options);
+		if (address && !writer.AddQuestion(std::string_view(name, name_length), record_type, MDNS_CLASS_IN)) {
+			return -1;
+		}
+		const size_t added = writer.AddRecords(PacketWriter::Section::Answer, records + sent, count - sent);
+		if (added == 0) {
+			// A single record larger than the buffer
+			return -1;
+		}
+		if (SendPacket(sock, address, address_size, writer) != 0) {
+			ret = -1;
+		}
+		sent += added;
+	}
+	return ret;
+}
+
+inline int AnnounceMulticast(int sock, void* buffer, size_t capacity, const mdns_record_t& answer,
+                             const mdns_record_t* additional, size_t additional_count)
+{
+	return AnswerMulticast(sock, buffer, capacity, answer, additional, additional_count);
+}
+
+inline int GoodbyeMulticast(int sock, void* buffer, size_t capacity, const mdns_record_t& answer,
+                            const mdns_record_t* additional, size_t additional_count)
+{
+	PacketOptions options;
+	options.ttl = 0;
+	return AnswerMulticast(sock, buffer, capacity, answer, additional, additional_count, options);
+}
+
+// Sends records as the answers of unsolicited responses, using as many packets as needed
+inline int AnnounceRecords(int sock, void* buffer, size_t capacity, const mdns_record_t* records, size_t count,
+                           PacketOptions options = PacketOptions())
+{
+	int ret = 0;
+	size_t sent = 0;
+	while (sent < count) {
+		PacketWriter writer(buffer, capacity, options);
+		const size_t added = writer.AddRecords(PacketWriter::Section::Answer, records + sent, count - sent);
+		if (added == 0) {
+			// A single record larger than the buffer
+			return -1;
+		}
+		if (SendPacket(sock, nullptr, 0, writer) != 0) {
+			ret = -1;
+		}
+		sent += added;
+	}
+	return ret;
+}
+
+inline int GoodbyeRecords(int sock, void* buffer, size_t capacity, const mdns_record_t* records, size_t count)
+{
+	PacketOptions options;
+	options.ttl = 0;
+	return AnnounceRecords(sock, buffer, capacity, records, count, options);
+}
+
+struct Question {
+	std::string_view name;
+	uint16_t rtype{MDNS_RECORDTYPE_PTR};
+	uint16_t rclass{MDNS_CLASS_IN};
+};
+
+// Sends a query with known answers (RFC 6762 7.1). Known answers that do not fit go into
+// follow-up packets, every packet but the last has the TC bit set so responders wait for the
+// rest before answering (RFC 6762 7.2)
+inline int SendQuery(int sock, const void* address, size_t address_size, void* buffer, size_t capacity,
+                     uint16_t query_id, const Question* questions, size_t question_count,
+                     const mdns_record_t* known_answers = nullptr, size_t known_answer_count = 0)
+{
+	PacketOptions options;
+	options.query_id = query_id;
+	options.flags = 0;
+	options.cache_flush = false;
+
+	int ret = 0;
+	size_t sent = 0;
+	bool first = true;
+	do {
+		PacketWriter writer(buffer, capacity, options);
+		if (first) {
+			for (size_t i = 0; i < question_count; ++i) {
+				if (!writer.AddQuestion(questions[i].name, questions[i].rtype, questions[i].rclass)) {
+					return -1;
+				}
+			}
+		}
+		const size_t added = writer.AddRecords(PacketWriter::Section::Answer, known_answers + sent, known_answer_count - sent);
+		if (!first && added == 0) {
+			return -1;
+		}
+		sent += added;
+		writer.SetTruncated(sent < known_answer_count);
+		if (SendPacket(sock, address, address_size, writer) != 0) {
+			ret = -1;
+		}
+		first = false;
+	} while (sent < known_answer_count);
+	return ret;
+}
+
+// Sends questions without known answers, as many per packet as fit.
+// Used to refresh a batch of cached names at once
+inline int SendQuestions(int sock, const void* address, size_t address_size, void* buffer, size_t capacity,
+                         uint16_t query_id, const Question* questions, size_t question_count)
+{
+	PacketOptions options;
+	options.query_id = query_id;
+	options.flags = 0;
+	options.cache_flush = false;
+
+	int ret = 0;
+	PacketWriter writer(buffer, capacity, options);
+	size_t i = 0;
+	while (i < question_count) {
+		if (writer.AddQuestion(questions[i].name, questions[i].rtype, questions[i].rclass)) {
+			++i;
+			continue;
+		}
+		// Does not fit even on its own
+		if (writer.Empty()) {
+			return -1;
+		}
+		if (SendPacket(sock, address, address_size, writer) != 0) {
+			ret = -1;
+		}
+		writer.Reset();
+	}
+	if (!writer.Empty() && SendPacket(sock, address, address_size, writer) != 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <Ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace mdns_cpp
+{
+
+// Per-source token buckets for incoming queries, one token per packet however many questions
+// it carries.
+// Sources live in a fixed-size set-associative table: a source address hashes to one set of
+// kWays slots (two cache lines) and, when the set is full, replaces the least recently used slot.
+// A flood from many spoofed addresses therefore only ever evicts other sources, it never grows
+// the table. Not thread safe, owned by the listen thread
+class RateLimiter
+{
+public:
+	// rate: query packets per second each source may send on average, burst: how many it may send
+	// at once. Dropped packets are counted in <throttled>
+	RateLimiter(double rate, double burst, std::size_t sources, std::atomic<std::uint64_t>& throttled)
+	: m_rate(static_cast<float>(rate / 1000.0))
+	, m_burst(static_cast<float>(std::max(burst, 1.0)))
+	, m_sets(std::max<std::size_t>(1, (sources + kWays - 1) / kWays))
+	, m_start(Clock::now())
+	, m_throttled(throttled)
+	{
+	}
+
+	// Takes a token from the bucket of <from>, false if it is empty and the packet should be dropped.
+	// Call once per packet
+	bool Allow(const struct sockaddr* from)
+	{
+		const std::uint64_t hash = Hash(from);
+		const std::uint32_t key = static_cast<std::uint32_t>(hash >> 32) | 1u;
+		const std::uint64_t now = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_start).count());
+		auto& set = m_sets[hash % m_sets.size()].slots;
+
+		Slot* slot = nullptr;
+		Slot* oldest = &set[0];
+		for (auto& candidate : set) {
+			if (candidate.key == key) {
+				slot = &candidate;
+				break;
+			}
+			if (candidate.key == 0 || (oldest->key != 0 && candidate.last_used < oldest->last_used)) {
+				oldest = &candidate;
+			}
+		}
+		if (!slot) {
+			slot = oldest;
+			slot->key = key;
+			slot->tokens = m_burst;
+		} else {
+			slot->tokens = std::min(m_burst, slot->tokens + static_cast<float>(now - slot->last_used) * m_rate);
+		}
+		slot->last_used = now;
+
+		if (slot->tokens < 1.0f) {
+			m_throttled.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		slot->tokens -= 1.0f;
+		return true;
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr std::size_t kWays = 8;
+
+	struct Slot {
+		std::uint64_t last_used{0}; // milliseconds since construction
+		std::uint32_t key{0};       // upper half of the address hash, 0 for an unused slot
+		float tokens{0};
+	};
+	static_assert(sizeof(Slot) == 16, "four slots per cache line");
+	struct alignas(64) Set {
+		std::array<Slot, kWays> slots;
+	};
+
+	// FNV-1a over the address bytes, the port is ignored so a client cannot dodge the
+	// limit by switching source ports
+	static std::uint64_t Hash(const struct sockaddr* from)
+	{
+		const unsigned char* bytes = nullptr;
+		std::size_t size = 0;
+		if (from->sa_family == AF_INET6) {
+			bytes = reinterpret_cast<const struct sockaddr_in6*>(from)->sin6_addr.s6_addr;
+			size = 16;
+		} else {
+			bytes = reinterpret_cast<const unsigned char*>(&reinterpret_cast<const struct sockaddr_in*>(from)->sin_addr);
+			size = 4;
+		}
+		std::uint64_t hash = 14695981039346656037ull;
+		for (std::size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	const float m_rate; // tokens per millisecond
+	const float m_burst;
+	std::vector<Set> m_sets;
+	const Clock::time_point m_start;
+	std::atomic<std::uint64_t>& m_throttled;
+};
+
+}
@@ -0,0 +1,409 @@
+#include "mdns_cpp/record_cache.hpp"
+#include "record_traits.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// RFC 6762 10.2: records older than this are flushed when a cache-flush record arrives
+constexpr std::chrono::seconds kCacheFlushGrace{1};
+
+// Snapshot file layout, all integers in host byte order:
+//   SnapshotHeader
+//   count times: SnapshotEntry, name bytes, rdata bytes
+// rdata is written by RecordTraits<T>::Save() of the record's type, see record_traits.hpp
+constexpr char kSnapshotMagic[4] = {'M', 'D', 'R', 'C'};
+// Bump whenever the layout changes, older snapshots are then ignored
+constexpr std::uint16_t kSnapshotVersion = 1;
+constexpr std::uint16_t kSnapshotByteOrder = 0x0102;
+
+struct SnapshotHeader
+{
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t byte_order;
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+struct SnapshotEntry
+{
+    // Absolute expiry, milliseconds since the system clock epoch
+    std::int64_t expiry_ms;
+    std::uint16_t type;
+    std::uint16_t rclass;
+    std::uint16_t rdata_length;
+    std::uint8_t name_length;
+    std::uint8_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 16, "snapshot header layout");
+static_assert(sizeof(SnapshotEntry) == 16, "snapshot entry layout");
+
+// rdata as described above, nullopt for records that are not stored
+std::optional<std::string> EncodeRData(const Record& record)
+{
+    std::string out;
+    if (!SaveRecord(record, out)) {
+        return std::nullopt;
+    }
+    return out;
+}
+
+std::optional<Record> DecodeRecord(const SnapshotEntry& entry, std::string_view name, std::string_view rdata)
+{
+    RecordHeader header;
+    header.entry_type = EntryType::ANSWER;
+    header.entry_string = name;
+    header.record_type = entry.type;
+    header.rclass = entry.rclass;
+    header.record_length = rdata.size();
+
+    Record record;
+    if (!LoadRecord(entry.type, std::move(header), rdata, record)) {
+        return std::nullopt;
+    }
+    return record;
+}
+
+// Read-only view of a whole file, memory-mapped where available
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+#ifndef _WIN32
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                m_data = static_cast<const char*>(mapped);
+                m_size = static_cast<std::size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+        }
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (m_data) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const char* m_data{nullptr};
+    std::size_t m_size{0};
+#ifdef _WIN32
+    std::string m_buffer;
+#endif
+};
+
+}
+
+RecordCache& RecordCache::GetInstance()
+{
+    static RecordCache instance;
+    return instance;
+}
+
+void RecordCache::Insert(const Record& record)
+{
+    const RecordHeader& header = GetHeader(record);
+    if (header.entry_type == EntryType::QUESTION || std::holds_alternative<AnyRecord>(record)) {
+        return;
+    }
+    const Key key{header.entry_string, RecordTypeOf(record)};
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& entries = m_entries[key];
+    const bool cacheFlush = (header.rclass & MDNS_CACHE_FLUSH) != 0;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+        return SameRData(entry.record, record) || (cacheFlush && now - entry.received > kCacheFlushGrace);
+    }), entries.end());
+
+    if (header.ttl > 0) {
+        entries.push_back({record, now, now + std::chrono::seconds(header.ttl)});
+    }
+    if (entries.empty()) {
+        m_entries.erase(key);
+    }
+
+    if (++m_insertsSincePurge >= kPurgeInterval) {
+        PurgeExpiredLocked(now);
+    }
+}
+
+std::vector<Record> RecordCache::Find(const DomainName& name, RecordType type) const
+{
+    std::vector<Record> out;
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_entries.find(Key{name, static_cast<std::uint16_t>(type)});
+    if (it == m_entries.end()) {
+        return out;
+    }
+    for (const auto& entry : it->second) {
+        if (entry.expiry > now) {
+            out.push_back(entry.record);
+            GetHeader(out.back()).ttl = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(entry.expiry - now).count());
+        }
+    }
+    return out;
+}
+
+std::vector<Record> RecordCache::KnownAnswers(const DomainName& name, RecordType type) const
+{
+    std::vector<Record> out;
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_entries.find(Key{name, static_cast<std::uint16_t>(type)});
+    if (it == m_entries.end()) {
+        return out;
+    }
+    for (const auto& entry : it->second) {
+        const auto left = entry.expiry - now;
+        if (left * 2 > entry.expiry - entry.received) {
+            out.push_back(entry.record);
+            GetHeader(out.back()).ttl = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(left).count());
+        }
+    }
+    return out;
+}
+
+std::vector<Record> RecordCache::FindAll(RecordType type) const
+{
+    std::vector<Record> out;
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [key, entries] : m_entries) {
+        if (key.type != static_cast<std::uint16_t>(type)) {
+            continue;
+        }
+        for (const auto& entry : entries) {
+            if (entry.expiry > now) {
+                out.push_back(entry.record);
+                GetHeader(out.back()).ttl = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(entry.expiry - now).count());
+            }
+        }
+    }
+    return out;
+}
+
+void RecordCache::PurgeExpired()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PurgeExpiredLocked(Clock::now());
+}
+
+void RecordCache::PurgeExpiredLocked(Clock::time_point now)
+{
+    m_insertsSincePurge = 0;
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        auto& entries = it->second;
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [now](const Entry& entry) {
+            return entry.expiry <= now;
+        }), entries.end());
+        it = entries.empty() ? m_entries.erase(it) : std::next(it);
+    }
+}
+
+void RecordCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
+
+std::size_t RecordCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t size = 0;
+    for (const auto& [key, entries] : m_entries) {
+        size += entries.size();
+    }
+    return size;
+}
+
+bool RecordCache::SaveSnapshot(const std::string& path) const
+{
+    const auto now = Clock::now();
+    const auto wallNow = std::chrono::system_clock::now();
+
+    std::string out(sizeof(SnapshotHeader), '\0');
+    std::uint32_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& [key, entries] : m_entries) {
+            for (const auto& entry : entries) {
+                if (entry.expiry <= now) {
+                    continue;
+                }
+                const auto rdata = EncodeRData(entry.record);
+                if (!rdata || rdata->size() > UINT16_MAX) {
+                    continue;
+                }
+                const auto expiry = wallNow + std::chrono::duration_cast<std::chrono::system_clock::duration>(entry.expiry - now);
+                SnapshotEntry header{};
+                header.expiry_ms = std::chrono::duration_cast<std::chrono::milliseconds>(expiry.time_since_epoch()).count();
+                header.type = key.type;
+                header.rclass = GetHeader(entry.record).rclass;
+                header.rdata_length = static_cast<std::uint16_t>(rdata->size());
+                header.name_length = static_cast<std::uint8_t>(key.name.size());
+                AppendBytes(out, &header, sizeof(header));
+                out += key.name.view();
+                out += *rdata;
+                ++count;
+            }
+        }
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.byte_order = kSnapshotByteOrder;
+    header.count = count;
+    std::memcpy(&out[0], &header, sizeof(header));
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size())) || !file.flush()) {
+            Log(LogLevel::Warn, fmt::format("Failed to write record cache snapshot {}", tmpPath));
+            return false;
+        }
+    }
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        Log(LogLevel::Warn, fmt::format("Failed to replace record cache snapshot {}", path));
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    Log(LogLevel::Debug, fmt::format("Saved {} records to {}", count, path));
+    return true;
+}
+
+std::size_t RecordCache::LoadSnapshot(const std::string& path)
+{
+    const MappedFile file(path);
+    if (file.size() < sizeof(SnapshotHeader)) {
+        return 0;
+    }
+    SnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0 || header.version != kSnapshotVersion ||
+        header.byte_order != kSnapshotByteOrder) {
+        Log(LogLevel::Info, fmt::format("Ignoring record cache snapshot {}, unknown format or version", path));
+        return 0;
+    }
+
+    const auto now = Clock::now();
+    const auto wallNowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::size_t loaded = 0;
+    std::size_t offset = sizeof(SnapshotHeader);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::uint32_t i = 0; i < header.count; ++i) {
+        SnapshotEntry entry;
+        if (file.size() - offset < sizeof(entry)) {
+            break;
+        }
+        std::memcpy(&entry, file.data() + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (file.size() - offset < static_cast<std::size_t>(entry.name_length) + entry.rdata_length) {
+            break;
+        }
+        const std::string_view name(file.data() + offset, entry.name_length);
+        const std::string_view rdata(file.data() + offset + entry.name_length, entry.rdata_length);
+        offset += entry.name_length + entry.rdata_length;
+
+        const auto remainingMs = entry.expiry_ms - wallNowMs;
+        if (remainingMs <= 0) {
+            continue;
+        }
+        auto record = DecodeRecord(entry, name, rdata);
+        if (!record) {
+            continue;
+        }
+        auto& entries = m_entries[Key{DomainName(name), entry.type}];
+        if (std::any_of(entries.begin(), entries.end(), [&record](const Entry& existing) { return SameRData(existing.record, *record); })) {
+            // Already seen on the network since startup, that copy is fresher
+            continue;
+        }
+        const auto remaining = std::chrono::milliseconds(remainingMs);
+        GetHeader(*record).ttl = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(remaining).count());
+        // Received "long ago", so a cache-flush record from the owner replaces it straight away
+        entries.push_back({std::move(*record), Clock::time_point(), now + remaining, false});
+        ++loaded;
+    }
+    if (offset != file.size()) {
+        Log(LogLevel::Warn, fmt::format("Record cache snapshot {} is truncated or corrupt, loaded {} records", path, loaded));
+    } else {
+        Log(LogLevel::Info, fmt::format("Loaded {} records from {}", loaded, path));
+    }
+    return loaded;
+}
+
+std::vector<std::pair<DomainName, RecordType>> RecordCache::Unconfirmed() const
+{
+    std::vector<std::pair<DomainName, RecordType>> out;
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [key, entries] : m_entries) {
+        const bool unconfirmed = std::any_of(entries.begin(), entries.end(), [now](const Entry& entry) {
+            return !entry.confirmed && entry.expiry > now;
+        });
+        if (unconfirmed) {
+            out.emplace_back(key.name, static_cast<RecordType>(key.type));
+        }
+    }
+    return out;
+}
+
+}
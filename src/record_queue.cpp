@@ -0,0 +1,112 @@
+#include "mdns_cpp/record_queue.hpp"
+
+namespace mdns_cpp
+{
+
+struct RecordQueue::Cell
+{
+    // Equal to the position when the cell is free to push at it, position + 1 once it holds a record
+    std::atomic<std::size_t> sequence;
+    Record record;
+};
+
+namespace
+{
+
+std::size_t RoundUpToPowerOfTwo(std::size_t value)
+{
+    std::size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+RecordQueue::RecordQueue(std::size_t capacity, OverflowPolicy policy)
+: m_policy(policy)
+, m_mask(RoundUpToPowerOfTwo(capacity) - 1)
+, m_cells(new Cell[m_mask + 1])
+{
+    for (std::size_t i = 0; i <= m_mask; ++i) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+RecordQueue::~RecordQueue() = default;
+
+bool RecordQueue::TryPush(Record& record)
+{
+    std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = m_cells[pos & m_mask];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.record = std::move(record);
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // Full
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool RecordQueue::Push(Record record)
+{
+    if (TryPush(record)) {
+        m_pushed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (m_policy == OverflowPolicy::DropOldest) {
+        // Consumers race us for the freed cell, give up after a few rounds rather than spin
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            if (Pop()) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (TryPush(record)) {
+                m_pushed.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::optional<Record> RecordQueue::Pop()
+{
+    std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = m_cells[pos & m_mask];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                std::optional<Record> record(std::move(cell.record));
+                cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                return record;
+            }
+        } else if (diff < 0) {
+            // Empty
+            return std::nullopt;
+        } else {
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+std::size_t RecordQueue::Size() const
+{
+    const std::size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+    const std::size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+}
@@ -0,0 +1,293 @@
+#include "mdns_cpp/record_table.hpp"
+#include "record_traits.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// Appends to a payload column, returns the index of the new entry
+template <typename Vector, typename Value>
+std::uint32_t Push(Vector& column, Value&& value)
+{
+    column.push_back(std::forward<Value>(value));
+    return static_cast<std::uint32_t>(column.size() - 1);
+}
+
+}
+
+std::string_view RecordTable::Pool::Get(std::uint32_t id) const
+{
+    const Span& span = spans[id];
+    return std::string_view(data).substr(span.offset, span.length);
+}
+
+RecordTable::NameId RecordTable::InternName(std::string_view name)
+{
+    // Every spelling of a name lands in the same bucket, only the exact one is reused
+    const std::size_t hash = DomainNameHash(name);
+    const auto range = m_namePool.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (m_namePool.Get(it->second) == name) {
+            return it->second;
+        }
+    }
+    const auto id = static_cast<NameId>(m_namePool.spans.size());
+    m_namePool.spans.push_back({static_cast<std::uint32_t>(m_namePool.data.size()), static_cast<std::uint32_t>(name.size())});
+    m_namePool.data.append(name);
+    m_namePool.index.emplace(hash, id);
+    return id;
+}
+
+RecordTable::StringId RecordTable::InternString(std::string_view text)
+{
+    const std::size_t hash = std::hash<std::string_view>()(text);
+    const auto range = m_stringPool.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (m_stringPool.Get(it->second) == text) {
+            return it->second;
+        }
+    }
+    const auto id = static_cast<StringId>(m_stringPool.spans.size());
+    m_stringPool.spans.push_back({static_cast<std::uint32_t>(m_stringPool.data.size()), static_cast<std::uint32_t>(text.size())});
+    m_stringPool.data.append(text);
+    m_stringPool.index.emplace(hash, id);
+    return id;
+}
+
+void RecordTable::Reserve(std::size_t rows)
+{
+    m_types.reserve(rows);
+    m_classes.reserve(rows);
+    m_ttls.reserve(rows);
+    m_names.reserve(rows);
+    m_entries.reserve(rows);
+    m_sources.reserve(rows);
+    m_lengths.reserve(rows);
+    m_payloads.reserve(rows);
+}
+
+template <>
+struct RecordTable::Column<DomainNamePointerRecord> {
+    static std::uint32_t Append(RecordTable& table, const DomainNamePointerRecord& record) {
+        return Push(table.m_ptrTargets, table.InternName(record.name_string.view()));
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        return DomainNamePointerRecord{std::move(header), table.Name(table.m_ptrTargets[payload])};
+    }
+};
+
+template <>
+struct RecordTable::Column<ServiceRecord> {
+    static std::uint32_t Append(RecordTable& table, const ServiceRecord& record) {
+        return Push(table.m_services, Srv{table.InternName(record.service_name.view()), record.priority, record.weight, record.port});
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        const Srv& srv = table.m_services[payload];
+        return ServiceRecord{std::move(header), table.Name(srv.target), srv.priority, srv.weight, srv.port};
+    }
+};
+
+template <>
+struct RecordTable::Column<ARecord> {
+    static std::uint32_t Append(RecordTable& table, const ARecord& record) {
+        return Push(table.m_ipv4Addresses, table.InternString(record.address_string));
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        return ARecord{std::move(header), std::string(table.String(table.m_ipv4Addresses[payload]))};
+    }
+};
+
+template <>
+struct RecordTable::Column<AAAARecord> {
+    static std::uint32_t Append(RecordTable& table, const AAAARecord& record) {
+        return Push(table.m_ipv6Addresses, table.InternString(record.address_string));
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        return AAAARecord{std::move(header), std::string(table.String(table.m_ipv6Addresses[payload]))};
+    }
+};
+
+template <>
+struct RecordTable::Column<TXTRecord> {
+    static std::uint32_t Append(RecordTable& table, const TXTRecord& record) {
+        return Push(table.m_txts, record.txt);
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        return TXTRecord{std::move(header), table.m_txts[payload]};
+    }
+};
+
+template <>
+struct RecordTable::Column<CNAMERecord> {
+    static std::uint32_t Append(RecordTable& table, const CNAMERecord& record) {
+        return Push(table.m_cnameTargets, table.InternName(record.target.view()));
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        return CNAMERecord{std::move(header), table.Name(table.m_cnameTargets[payload])};
+    }
+};
+
+template <>
+struct RecordTable::Column<HINFORecord> {
+    static std::uint32_t Append(RecordTable& table, const HINFORecord& record) {
+        return Push(table.m_hinfos, Hinfo{record.cpu, record.os});
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        const Hinfo& hinfo = table.m_hinfos[payload];
+        return HINFORecord{std::move(header), hinfo.cpu, hinfo.os};
+    }
+};
+
+template <>
+struct RecordTable::Column<NSECRecord> {
+    static std::uint32_t Append(RecordTable& table, const NSECRecord& record) {
+        return Push(table.m_nsecs, Nsec{table.InternName(record.next_domain.view()), record.types});
+    }
+    static Record Get(const RecordTable& table, std::uint32_t payload, RecordHeader&& header) {
+        const Nsec& nsec = table.m_nsecs[payload];
+        return NSECRecord{std::move(header), table.Name(nsec.next_domain), nsec.types};
+    }
+};
+
+// Questions and unknown types keep just the header
+template <>
+struct RecordTable::Column<AnyRecord> {
+    static std::uint32_t Append(RecordTable&, const AnyRecord&) {
+        return kNoPayload;
+    }
+    static Record Get(const RecordTable&, std::uint32_t, RecordHeader&& header) {
+        return AnyRecord{std::move(header)};
+    }
+};
+
+struct RecordTable::Columns {
+    using GetFunction = Record (*)(const RecordTable& table, std::uint32_t payload, RecordHeader&& header);
+
+    // Column<T>::Get() by wire type, from the same type list as kRecordTypes
+    template <typename... T>
+    static constexpr std::array<GetFunction, kRecordTypeCount> MakeGetTable(RecordTypeList<T...>) {
+        std::array<GetFunction, kRecordTypeCount> table{};
+        ((table[static_cast<std::size_t>(RecordTraits<T>::kType)] = &Column<T>::Get), ...);
+        return table;
+    }
+};
+
+void RecordTable::Append(const Record& record)
+{
+    const RecordHeader& header = GetHeader(record);
+    m_types.push_back(RecordTypeOf(record));
+    m_classes.push_back(header.rclass);
+    m_ttls.push_back(header.ttl);
+    m_names.push_back(InternName(header.entry_string.view()));
+    m_entries.push_back(header.entry_type);
+    m_sources.push_back(InternString(header.ip_address));
+    m_lengths.push_back(static_cast<std::uint16_t>(std::min<std::size_t>(header.record_length, 0xFFFF)));
+    m_payloads.push_back(std::visit([this](const auto& rec) {
+        return Column<std::decay_t<decltype(rec)>>::Append(*this, rec);
+    }, record));
+}
+
+void RecordTable::Clear()
+{
+    m_types.clear();
+    m_classes.clear();
+    m_ttls.clear();
+    m_names.clear();
+    m_entries.clear();
+    m_sources.clear();
+    m_lengths.clear();
+    m_payloads.clear();
+    m_ptrTargets.clear();
+    m_services.clear();
+    m_ipv4Addresses.clear();
+    m_ipv6Addresses.clear();
+    m_txts.clear();
+    m_cnameTargets.clear();
+    m_hinfos.clear();
+    m_nsecs.clear();
+}
+
+std::string_view RecordTable::Name(NameId id) const
+{
+    return m_namePool.Get(id);
+}
+
+std::optional<RecordTable::NameId> RecordTable::FindName(std::string_view name) const
+{
+    // The bucket is in no particular order, the lowest id is the first spelling interned
+    std::optional<NameId> found;
+    const auto range = m_namePool.index.equal_range(DomainNameHash(name));
+    for (auto it = range.first; it != range.second; ++it) {
+        if ((!found || it->second < *found) && DomainNameEquals(m_namePool.Get(it->second), name)) {
+            found = it->second;
+        }
+    }
+    return found;
+}
+
+std::size_t RecordTable::NameCount() const
+{
+    return m_namePool.spans.size();
+}
+
+std::string_view RecordTable::String(StringId id) const
+{
+    return m_stringPool.Get(id);
+}
+
+std::vector<std::size_t> RecordTable::Select(RecordType type) const
+{
+    const auto wanted = static_cast<std::uint16_t>(type);
+    std::vector<std::size_t> rows;
+    for (std::size_t row = 0; row < m_types.size(); ++row) {
+        if (m_types[row] == wanted) {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+std::size_t RecordTable::Count(RecordType type) const
+{
+    return static_cast<std::size_t>(std::count(m_types.begin(), m_types.end(), static_cast<std::uint16_t>(type)));
+}
+
+Record RecordTable::At(std::size_t row) const
+{
+    RecordHeader header;
+    header.ip_address = std::string(String(m_sources[row]));
+    header.entry_type = m_entries[row];
+    header.entry_string = Name(m_names[row]);
+    header.record_type = m_types[row];
+    header.rclass = m_classes[row];
+    header.ttl = m_ttls[row];
+    header.record_length = m_lengths[row];
+
+    static constexpr auto kGet = Columns::MakeGetTable(KnownRecordTypes());
+    const std::uint32_t payload = m_payloads[row];
+    const Columns::GetFunction get = m_types[row] < kGet.size() ? kGet[m_types[row]] : nullptr;
+    if (payload == kNoPayload || !get) {
+        return AnyRecord{std::move(header)};
+    }
+    return get(*this, payload, std::move(header));
+}
+
+std::vector<Record> RecordTable::Records() const
+{
+    std::vector<Record> records;
+    records.reserve(Size());
+    for (std::size_t row = 0; row < Size(); ++row) {
+        records.push_back(At(row));
+    }
+    return records;
+}
+
+}
@@ -0,0 +1,511 @@
+#pragma once
+
+#include "mdns.h"
+#include "mdns_cpp/types.hpp"
+#include "types_utils.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace mdns_cpp
+{
+
+// RDATA of one resource record in a received packet. data/size cover the whole packet since
+// names in RDATA may point anywhere into it
+struct RDataView {
+	const void* data;
+	size_t size;
+	size_t offset;
+	size_t length;
+
+	[[nodiscard]] bool Valid() const { return offset <= size && length <= size - offset; }
+	[[nodiscard]] const uint8_t* begin() const { return static_cast<const uint8_t*>(data) + offset; }
+};
+
+inline std::string_view View(mdns_string_t str)
+{
+	return std::string_view(str.str, str.length);
+}
+
+// Raw host-order bytes, for the record cache snapshot
+inline void AppendBytes(std::string& out, const void* data, size_t size)
+{
+	out.append(static_cast<const char*>(data), size);
+}
+
+// Everything that differs between record types: the wire type, its name in logs, parsing RDATA
+// into the record, the mdns_record_t(s) it is sent as (through its Convert() overload in
+// types_utils.hpp), writing their RDATA into a packet, the record cache snapshot form and
+// comparing RDATA.
+// Write() is a template over the writer so this header does not depend on PacketWriter, which
+// instantiates it for itself. Save() appends the snapshot form and returns false for records
+// that are not stored, Load() reads it back.
+// Supporting another type means a variant alternative in types.hpp, a Convert() overload, a
+// specialization here and an entry in KnownRecordTypes below; the callbacks, PacketWriter and the
+// cache pick it up from there
+template <typename T>
+struct RecordTraits;
+
+template <>
+struct RecordTraits<DomainNamePointerRecord> {
+	static constexpr RecordType kType = RecordType::PTR;
+	static constexpr const char* kName = "PTR";
+
+	static void Parse(const RDataView& rdata, DomainNamePointerRecord& record) {
+		char namebuffer[256];
+		const mdns_string_t name = mdns_record_parse_ptr(rdata.data, rdata.size, rdata.offset, rdata.length, namebuffer, sizeof(namebuffer));
+		record.name_string = std::string_view(name.str, name.length);
+	}
+	static void Encode(const DomainNamePointerRecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) { return writer.WriteName(View(records[0].data.ptr.name)); }
+	static bool Save(const DomainNamePointerRecord& record, std::string& out) {
+		out += record.name_string.view();
+		return true;
+	}
+	static bool Load(std::string_view rdata, DomainNamePointerRecord& record) {
+		record.name_string = rdata;
+		return true;
+	}
+	static bool SameRData(const DomainNamePointerRecord& lhs, const DomainNamePointerRecord& rhs) { return lhs.name_string == rhs.name_string; }
+};
+
+template <>
+struct RecordTraits<ServiceRecord> {
+	static constexpr RecordType kType = RecordType::SRV;
+	static constexpr const char* kName = "SRV";
+
+	static void Parse(const RDataView& rdata, ServiceRecord& record) {
+		char namebuffer[256];
+		const mdns_record_srv_t srv = mdns_record_parse_srv(rdata.data, rdata.size, rdata.offset, rdata.length, namebuffer, sizeof(namebuffer));
+		record.service_name = std::string_view(srv.name.str, srv.name.length);
+		record.priority = srv.priority;
+		record.weight = srv.weight;
+		record.port = srv.port;
+	}
+	static void Encode(const ServiceRecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) {
+		const mdns_record_srv_t& srv = records[0].data.srv;
+		return writer.WriteU16(srv.priority) && writer.WriteU16(srv.weight) && writer.WriteU16(srv.port) && writer.WriteName(View(srv.name));
+	}
+	// priority, weight and port, then the target
+	static bool Save(const ServiceRecord& record, std::string& out) {
+		AppendBytes(out, &record.priority, sizeof(record.priority));
+		AppendBytes(out, &record.weight, sizeof(record.weight));
+		AppendBytes(out, &record.port, sizeof(record.port));
+		out += record.service_name.view();
+		return true;
+	}
+	static bool Load(std::string_view rdata, ServiceRecord& record) {
+		if (rdata.size() < 3 * sizeof(uint16_t)) {
+			return false;
+		}
+		std::memcpy(&record.priority, rdata.data(), sizeof(record.priority));
+		std::memcpy(&record.weight, rdata.data() + 2, sizeof(record.weight));
+		std::memcpy(&record.port, rdata.data() + 4, sizeof(record.port));
+		record.service_name = rdata.substr(6);
+		return true;
+	}
+	static bool SameRData(const ServiceRecord& lhs, const ServiceRecord& rhs) {
+		return lhs.service_name == rhs.service_name && lhs.port == rhs.port && lhs.priority == rhs.priority && lhs.weight == rhs.weight;
+	}
+};
+
+template <>
+struct RecordTraits<ARecord> {
+	static constexpr RecordType kType = RecordType::A;
+	static constexpr const char* kName = "A";
+
+	static void Parse(const RDataView& rdata, ARecord& record) {
+		struct sockaddr_in addr;
+		mdns_record_parse_a(rdata.data, rdata.size, rdata.offset, rdata.length, &addr);
+		record.address_string = IPV4AddressToString(&addr, sizeof(addr));
+	}
+	static void Encode(const ARecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) { return writer.WriteBytes(&records[0].data.a.addr.sin_addr, 4); }
+	// The address as text
+	static bool Save(const ARecord& record, std::string& out) {
+		out += record.address_string;
+		return true;
+	}
+	static bool Load(std::string_view rdata, ARecord& record) {
+		record.address_string = std::string(rdata);
+		return true;
+	}
+	static bool SameRData(const ARecord& lhs, const ARecord& rhs) { return lhs.address_string == rhs.address_string; }
+};
+
+template <>
+struct RecordTraits<AAAARecord> {
+	static constexpr RecordType kType = RecordType::AAAA;
+	static constexpr const char* kName = "AAAA";
+
+	static void Parse(const RDataView& rdata, AAAARecord& record) {
+		struct sockaddr_in6 addr;
+		mdns_record_parse_aaaa(rdata.data, rdata.size, rdata.offset, rdata.length, &addr);
+		record.address_string = IPV6AddressToString(&addr, sizeof(addr));
+	}
+	static void Encode(const AAAARecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) { return writer.WriteBytes(&records[0].data.aaaa.addr.sin6_addr, 16); }
+	// The address as text
+	static bool Save(const AAAARecord& record, std::string& out) {
+		out += record.address_string;
+		return true;
+	}
+	static bool Load(std::string_view rdata, AAAARecord& record) {
+		record.address_string = std::string(rdata);
+		return true;
+	}
+	static bool SameRData(const AAAARecord& lhs, const AAAARecord& rhs) { return lhs.address_string == rhs.address_string; }
+};
+
+template <>
+struct RecordTraits<TXTRecord> {
+	static constexpr RecordType kType = RecordType::TXT;
+	static constexpr const char* kName = "TXT";
+
+	// Keep the RDATA in wire format, TxtData indexes it in place
+	static void Parse(const RDataView& rdata, TXTRecord& record) {
+		if (rdata.Valid()) {
+			record.txt = TxtData::FromWire(rdata.begin(), rdata.length);
+		}
+	}
+	// One mdns_record_t per key, PacketWriter merges them back into a single record
+	static void Encode(const TXTRecord& record, std::vector<mdns_record_t>& out) {
+		const auto converted = Convert(record);
+		out.insert(out.end(), converted.begin(), converted.end());
+	}
+	// One string per key: "key=value", "key=" for an empty but non-null value and a bare boolean
+	// "key" for a null one (RFC 6763 6.4)
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t count) {
+		bool wrote = false;
+		for (size_t i = 0; i < count; ++i) {
+			const mdns_string_t key = records[i].data.txt.key;
+			const mdns_string_t value = records[i].data.txt.value;
+			if (!key.length) {
+				continue;
+			}
+			const bool has_value = value.str != nullptr;
+			const size_t length = key.length + (has_value ? value.length + 1 : 0);
+			if (length > 255 || !writer.WriteU8(static_cast<uint8_t>(length)) || !writer.WriteBytes(key.str, key.length)) {
+				return false;
+			}
+			if (has_value && (!writer.WriteU8('=') || !writer.WriteBytes(value.str, value.length))) {
+				return false;
+			}
+			wrote = true;
+		}
+		// An empty TXT record still needs a single empty string (RFC 6763 6.1)
+		return wrote || writer.WriteU8(0);
+	}
+	// The wire format
+	static bool Save(const TXTRecord& record, std::string& out) {
+		out += record.txt.Wire();
+		return true;
+	}
+	static bool Load(std::string_view rdata, TXTRecord& record) {
+		record.txt = TxtData::FromWire(rdata.data(), rdata.size());
+		return true;
+	}
+	static bool SameRData(const TXTRecord& lhs, const TXTRecord& rhs) { return lhs.txt == rhs.txt; }
+};
+
+template <>
+struct RecordTraits<CNAMERecord> {
+	static constexpr RecordType kType = RecordType::CNAME;
+	static constexpr const char* kName = "CNAME";
+
+	// Same RDATA as PTR, a single (possibly compressed) name
+	static void Parse(const RDataView& rdata, CNAMERecord& record) {
+		char namebuffer[256];
+		const mdns_string_t target = mdns_record_parse_ptr(rdata.data, rdata.size, rdata.offset, rdata.length, namebuffer, sizeof(namebuffer));
+		record.target = std::string_view(target.str, target.length);
+	}
+	static void Encode(const CNAMERecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	// Borrows the PTR union, see Convert()
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) { return writer.WriteName(View(records[0].data.ptr.name)); }
+	static bool Save(const CNAMERecord& record, std::string& out) {
+		out += record.target.view();
+		return true;
+	}
+	static bool Load(std::string_view rdata, CNAMERecord& record) {
+		record.target = rdata;
+		return true;
+	}
+	static bool SameRData(const CNAMERecord& lhs, const CNAMERecord& rhs) { return lhs.target == rhs.target; }
+};
+
+template <>
+struct RecordTraits<HINFORecord> {
+	static constexpr RecordType kType = RecordType::HINFO;
+	static constexpr const char* kName = "HINFO";
+
+	// Two <character-string>s, CPU then OS (RFC 1035 3.3.2)
+	static void Parse(const RDataView& rdata, HINFORecord& record) {
+		if (!rdata.Valid()) {
+			return;
+		}
+		size_t pos = 0;
+		if (ReadCharacterString(rdata, pos, record.cpu)) {
+			ReadCharacterString(rdata, pos, record.os);
+		}
+	}
+	static void Encode(const HINFORecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	// Borrows the TXT union, CPU as the key and OS as the value
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) {
+		return writer.WriteCharacterString(records[0].data.txt.key) && writer.WriteCharacterString(records[0].data.txt.value);
+	}
+	// Both strings length-prefixed, as on the wire
+	static bool Save(const HINFORecord& record, std::string& out) {
+		const std::string cpu = record.cpu.substr(0, 255);
+		const std::string os = record.os.substr(0, 255);
+		out += static_cast<char>(cpu.size());
+		out += cpu;
+		out += static_cast<char>(os.size());
+		out += os;
+		return true;
+	}
+	static bool Load(std::string_view rdata, HINFORecord& record) {
+		if (rdata.empty() || 1u + static_cast<uint8_t>(rdata[0]) >= rdata.size()) {
+			return false;
+		}
+		const size_t cpu_length = static_cast<uint8_t>(rdata[0]);
+		record.cpu = std::string(rdata.substr(1, cpu_length));
+		rdata.remove_prefix(1 + cpu_length);
+		record.os = std::string(rdata.substr(1, static_cast<uint8_t>(rdata[0])));
+		return true;
+	}
+	static bool SameRData(const HINFORecord& lhs, const HINFORecord& rhs) { return lhs.cpu == rhs.cpu && lhs.os == rhs.os; }
+
+private:
+	static bool ReadCharacterString(const RDataView& rdata, size_t& pos, std::string& out) {
+		const uint8_t* bytes = rdata.begin();
+		if (pos >= rdata.length || pos + 1 + bytes[pos] > rdata.length) {
+			return false;
+		}
+		out.assign(reinterpret_cast<const char*>(bytes + pos + 1), bytes[pos]);
+		pos += 1 + bytes[pos];
+		return true;
+	}
+};
+
+template <>
+struct RecordTraits<NSECRecord> {
+	static constexpr RecordType kType = RecordType::NSEC;
+	static constexpr const char* kName = "NSEC";
+
+	// Next domain name followed by the type bitmap (RFC 4034 4.1). mDNS allows the name to be
+	// compressed (RFC 6762 18.14), so it is read like any other name
+	static void Parse(const RDataView& rdata, NSECRecord& record) {
+		if (!rdata.Valid()) {
+			return;
+		}
+		char namebuffer[256];
+		size_t offset = rdata.offset;
+		const mdns_string_t next = mdns_string_extract(rdata.data, rdata.offset + rdata.length, &offset, namebuffer, sizeof(namebuffer));
+		record.next_domain = std::string_view(next.str, next.length);
+		const size_t end = rdata.offset + rdata.length;
+		if (offset < end) {
+			record.types = TypeBitmap::FromWire(static_cast<const uint8_t*>(rdata.data) + offset, end - offset);
+		}
+	}
+	static void Encode(const NSECRecord& record, std::vector<mdns_record_t>& out) { out.push_back(Convert(record)); }
+	// Borrows the TXT union, the next domain as the key and the bitmap as the value
+	template <typename Writer>
+	static bool Write(Writer& writer, const mdns_record_t* records, size_t) {
+		const mdns_string_t bitmap = records[0].data.txt.value;
+		return writer.WriteName(View(records[0].data.txt.key)) && writer.WriteBytes(bitmap.str, bitmap.length);
+	}
+	// Length-prefixed next domain, then the bitmap
+	static bool Save(const NSECRecord& record, std::string& out) {
+		out += static_cast<char>(record.next_domain.size());
+		out += record.next_domain.view();
+		out += record.types.Wire();
+		return true;
+	}
+	static bool Load(std::string_view rdata, NSECRecord& record) {
+		if (rdata.empty() || 1u + static_cast<uint8_t>(rdata[0]) > rdata.size()) {
+			return false;
+		}
+		const size_t name_length = static_cast<uint8_t>(rdata[0]);
+		record.next_domain = rdata.substr(1, name_length);
+		const auto bitmap = rdata.substr(1 + name_length);
+		record.types = TypeBitmap::FromWire(bitmap.data(), bitmap.size());
+		return true;
+	}
+	static bool SameRData(const NSECRecord& lhs, const NSECRecord& rhs) { return lhs.next_domain == rhs.next_domain && lhs.types == rhs.types; }
+};
+
+// Questions, and answers of types we do not know: only the header
+template <>
+struct RecordTraits<AnyRecord> {
+	static constexpr RecordType kType = RecordType::ANY;
+	static constexpr const char* kName = "ANY";
+
+	static void Parse(const RDataView&, AnyRecord&) {}
+	static void Encode(const AnyRecord&, std::vector<mdns_record_t>&) {}
+	// Nothing known about the RDATA, so none is written and nothing is stored
+	template <typename Writer>
+	static bool Write(Writer&, const mdns_record_t*, size_t) { return true; }
+	static bool Save(const AnyRecord&, std::string&) { return false; }
+	static bool Load(std::string_view, AnyRecord&) { return false; }
+	static bool SameRData(const AnyRecord&, const AnyRecord&) { return true; }
+};
+
+
+using ParseFunction = void (*)(RecordHeader&& header, const RDataView& rdata, Record& out);
+
+template <typename T>
+void ParseAs(RecordHeader&& header, const RDataView& rdata, Record& out)
+{
+	T record;
+	record.header = std::move(header);
+	RecordTraits<T>::Parse(rdata, record);
+	out = std::move(record);
+}
+
+using LoadFunction = bool (*)(RecordHeader&& header, std::string_view rdata, Record& out);
+
+template <typename T>
+bool LoadAs(RecordHeader&& header, std::string_view rdata, Record& out)
+{
+	T record;
+	record.header = std::move(header);
+	if (!RecordTraits<T>::Load(rdata, record)) {
+		return false;
+	}
+	out = std::move(record);
+	return true;
+}
+
+struct RecordTypeEntry {
+	const char* name{nullptr};
+	ParseFunction parse{nullptr};
+	LoadFunction load{nullptr};
+};
+
+template <typename... T>
+struct RecordTypeList {};
+
+// Every type with RecordTraits, the tables below are built from it
+using KnownRecordTypes = RecordTypeList<DomainNamePointerRecord, ServiceRecord, ARecord, AAAARecord, TXTRecord,
+                                        CNAMERecord, HINFORecord, NSECRecord, AnyRecord>;
+
+// Indexed by the type on the wire. Every type we handle is below 256, anything above is unknown
+constexpr size_t kRecordTypeCount = 256;
+using RecordTypeTable = std::array<RecordTypeEntry, kRecordTypeCount>;
+
+template <typename... T>
+constexpr RecordTypeTable MakeRecordTypeTable(RecordTypeList<T...>)
+{
+	RecordTypeTable table{};
+	((table[static_cast<size_t>(RecordTraits<T>::kType)] = RecordTypeEntry{RecordTraits<T>::kName, &ParseAs<T>, &LoadAs<T>}), ...);
+	return table;
+}
+
+inline constexpr RecordTypeTable kRecordTypes = MakeRecordTypeTable(KnownRecordTypes());
+
+// RDATA writers by wire type for <Writer>, i.e. PacketWriter. Kept apart from kRecordTypes since
+// they need the complete writer type
+template <typename Writer>
+using WriteFunction = bool (*)(Writer& writer, const mdns_record_t* records, size_t count);
+
+template <typename Writer, typename T>
+bool WriteAs(Writer& writer, const mdns_record_t* records, size_t count)
+{
+	return RecordTraits<T>::Write(writer, records, count);
+}
+
+template <typename Writer, typename... T>
+constexpr std::array<WriteFunction<Writer>, kRecordTypeCount> MakeWriteTable(RecordTypeList<T...>)
+{
+	std::array<WriteFunction<Writer>, kRecordTypeCount> table{};
+	((table[static_cast<size_t>(RecordTraits<T>::kType)] = &WriteAs<Writer, T>), ...);
+	return table;
+}
+
+// nullptr for a type that is not in kRecordTypes
+inline const RecordTypeEntry* FindRecordType(uint16_t rtype)
+{
+	if (rtype >= kRecordTypes.size() || !kRecordTypes[rtype].parse) {
+		return nullptr;
+	}
+	return &kRecordTypes[rtype];
+}
+
+// Parses the RDATA at <rdata> into the record type matching rtype, unknown types become an
+// AnyRecord with just the header
+inline void ParseRecord(uint16_t rtype, RecordHeader&& header, const RDataView& rdata, Record& out)
+{
+	const RecordTypeEntry* type = FindRecordType(rtype);
+	const ParseFunction parse = type ? type->parse : &ParseAs<AnyRecord>;
+	parse(std::move(header), rdata, out);
+}
+
+
+// Reads a record stored by SaveRecord(), false for a type that is not stored or a corrupt one
+inline bool LoadRecord(uint16_t rtype, RecordHeader&& header, std::string_view rdata, Record& out)
+{
+	const RecordTypeEntry* type = FindRecordType(rtype);
+	return type && type->load(std::move(header), rdata, out);
+}
+
+// Appends the record cache snapshot form of the record's RDATA, false if it is not stored
+inline bool SaveRecord(const Record& record, std::string& out)
+{
+	return std::visit([&out](const auto& rec) {
+		return RecordTraits<std::decay_t<decltype(rec)>>::Save(rec, out);
+	}, record);
+}
+
+// Record type on the wire, from the variant alternative rather than header.record_type
+inline std::uint16_t RecordTypeOf(const Record& record)
+{
+	return std::visit([](const auto& rec) -> std::uint16_t {
+		using T = std::decay_t<decltype(rec)>;
+		if constexpr (std::is_same_v<T, AnyRecord>) {
+			return rec.header.record_type;
+		} else {
+			return static_cast<std::uint16_t>(RecordTraits<T>::kType);
+		}
+	}, record);
+}
+
+// Any record as the mdns_record_t(s) needed to send it, TXT records expand to one per key.
+// The returned records point into <record>
+inline std::vector<mdns_record_t> Convert(const Record& record)
+{
+	std::vector<mdns_record_t> out;
+	std::visit([&out](const auto& rec) {
+		RecordTraits<std::decay_t<decltype(rec)>>::Encode(rec, out);
+	}, record);
+	return out;
+}
+
+// Same record data, ignoring the header (sender, TTL, ...)
+inline bool SameRData(const Record& lhs, const Record& rhs)
+{
+	if (lhs.index() != rhs.index()) {
+		return false;
+	}
+	return std::visit([&rhs](const auto& l) {
+		using T = std::decay_t<decltype(l)>;
+		return RecordTraits<T>::SameRData(l, std::get<T>(rhs));
+	}, lhs);
+}
+
+}
@@ -1,11 +1,18 @@
 #include "mdns_cpp/service.hpp"
+#include "mdns_cpp/record_cache.hpp"
 #include "mdns_cpp/types.hpp"
 #include "mdns_utils.hpp"
+#include "service_snapshot.hpp"
 #include "types_utils.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <future>
 #include <thread>
 #include <array>
+#include <mutex>
+#include <unordered_map>
 
 #include "log.hpp"
 #include <fmt/format.h>
@@ -13,123 +20,149 @@
 namespace mdns_cpp
 {
 
-struct ServiceData
-{
-	std::string service;
-	std::string hostname;
-	std::string service_instance;
-	std::string hostname_qualified;
-	OpenSocketsData sockets_data;
-	int port;
-
-	DomainNamePointerRecord record_ptr;
-	ServiceRecord record_service;
-	ARecord record_a;
-	AAAARecord record_aaaa;
-	TXTRecord record_txt;
-};
-
 class Service::ServiceImpl
 {
 private:
+	// Guards m_serviceSettings, m_socketsData and m_pendingSnapshot
+	mutable std::mutex m_settingsMutex;
 	ServiceSettings m_serviceSettings;
-	ServiceData m_serviceData;
-	service_t m_serviceDataForMdns;
+	OpenSocketsData m_socketsData;
+
+	// Read by the listen thread on every packet, replaced with std::atomic_store
+	std::shared_ptr<const ServiceSnapshot> m_snapshot;
+	// Built by Update*() calls, swapped in by the listen thread
+	std::shared_ptr<const ServiceSnapshot> m_pendingSnapshot;
 
 	std::atomic<bool> m_running{false};
 	std::thread m_listenThread;
+	std::shared_future<void> m_ready;
+
+	// Startup announcement schedule, only touched by the listen thread
+	std::uint32_t m_announcementsLeft{0};
+	std::chrono::steady_clock::time_point m_nextAnnouncement;
+	std::chrono::steady_clock::duration m_announcementInterval;
+
+	// Record cache snapshots, copied from the settings on Start()
+	std::string m_cacheSnapshotPath;
+	std::chrono::seconds m_cacheSnapshotInterval{0};
+	std::chrono::steady_clock::time_point m_nextCacheSnapshot;
+
+	// Interface index each socket currently sends multicast on, only touched by the listen thread
+	std::unordered_map<int, std::uint32_t> m_multicastInterfaces;
+
+	// Created on Start() when query_rate_limit is set, only used by the listen thread
+	std::unique_ptr<RateLimiter> m_rateLimiter;
+	std::atomic<std::uint64_t> m_throttledQueries{0};
+
+	// Created on Start() when there is an answer_provider, only used by the listen thread.
+	// FlushAnswers() asks the listen thread to clear it
+	std::unique_ptr<AnswerCache> m_answerCache;
+	std::atomic<bool> m_flushAnswers{false};
+
+	// Set on Start() from ServiceSettings::latency_tracing
+	bool m_latencyTracing{false};
+	bool m_receiveTimestamps{false};
+	ServiceLatency m_latency;
 
 public:
 	ServiceImpl(ServiceSettings settings)
+	: m_serviceSettings(std::move(settings))
 	{
-		SetSettings(std::move(settings));
 	}
 
-	~ServiceImpl() 
+	~ServiceImpl()
 	{
 		Stop();
 	}
 
 	void SetSettings(ServiceSettings settings)
 	{
-		m_serviceSettings = std::move(settings);
+		Update([&settings](ServiceSettings& current) {
+			current = std::move(settings);
+		});
+	}
+
+	void UpdateTxt(TxtData txt)
+	{
+		Update([&txt](ServiceSettings& current) {
+			current.txt = std::move(txt);
+		});
+	}
+
+	void SetTxtValue(std::string_view key, std::string_view value)
+	{
+		Update([key, value](ServiceSettings& current) {
+			current.txt.Set(key, value);
+		});
+	}
+
+	void RemoveTxtValue(std::string_view key)
+	{
+		Update([key](ServiceSettings& current) {
+			current.txt.Remove(key);
+		});
+	}
+
+	void UpdatePort(std::uint16_t port)
+	{
+		Update([port](ServiceSettings& current) {
+			current.port = port;
+		});
+	}
+
+	void AddRecord(Record record)
+	{
+		Update([&record](ServiceSettings& current) {
+			RemoveMatching(current.extra_records, GetHeader(record).entry_string, RecordTypeOf(record));
+			current.extra_records.push_back(std::move(record));
+		});
+	}
+
+	void RemoveRecord(const DomainName& name, RecordType type)
+	{
+		Update([&name, type](ServiceSettings& current) {
+			RemoveMatching(current.extra_records, name, static_cast<std::uint16_t>(type));
+		});
 	}
 
 	void OpenSockets()
 	{
-		if (m_serviceSettings.service_name.empty()) {
-			Log(LogLevel::Error, "Empty service name.");
-			throw std::runtime_error("Empty service name.");
+		InterfaceFilter filter;
+		{
+			std::lock_guard<std::mutex> lock(m_settingsMutex);
+			filter = m_serviceSettings.interfaces;
+			m_latencyTracing = m_serviceSettings.latency_tracing;
 		}
-
-		m_serviceData.sockets_data = OpenServiceSockets();
-		const auto num_sockets = m_serviceData.sockets_data.sockets.size();
+		auto sockets_data = OpenServiceSockets(filter);
+		m_receiveTimestamps = m_latencyTracing;
+		if (m_latencyTracing) {
+			for (const auto& socket : sockets_data.sockets) {
+				m_receiveTimestamps = EnableReceiveTimestamps(socket) && m_receiveTimestamps;
+			}
+		}
+		const auto num_sockets = sockets_data.sockets.size();
 		if (num_sockets == 0) {
+			m_running.store(false, std::memory_order_release);
 			Log(LogLevel::Error, "Failed to open any client sockets.");
 			throw std::runtime_error("Failed to open any client sockets.");
 		}
 		Log(LogLevel::Info, fmt::format("Opened {} socket{} for mDNS Service.", num_sockets, num_sockets > 1 ? "s": ""));
+
+		std::lock_guard<std::mutex> lock(m_settingsMutex);
+		m_socketsData = std::move(sockets_data);
 	}
 
-	void SetupData() 
+	void CloseSockets()
 	{
-		m_serviceData.port = m_serviceSettings.port;
-		m_serviceData.hostname = m_serviceSettings.hostname;
-		m_serviceData.service = m_serviceSettings.service_name;
-		if (m_serviceData.service.back() != '.') {
-			m_serviceData.service += '.';
-		}
-
-		Log(LogLevel::Info, fmt::format("Service mDNS: {}:{}", m_serviceData.service, m_serviceData.port));
-		Log(LogLevel::Info, fmt::format("Hostname: {}", m_serviceData.hostname));
-
-		// Build the service instance "<hostname>.<_service-name>._tcp.local." string
-		m_serviceData.service_instance = fmt::format("{}.{}", m_serviceData.hostname, m_serviceData.service);
-		// Build the "<hostname>.local." string
-		m_serviceData.hostname_qualified = fmt::format("{}.local.", m_serviceData.hostname);
-
-		// PTR record
-		m_serviceData.record_ptr.header.entry_string = m_serviceData.service;
-		m_serviceData.record_ptr.name_string = m_serviceData.service_instance;
-
-		// SRV record
-		m_serviceData.record_service.header.entry_string = m_serviceData.service_instance;
-		m_serviceData.record_service.service_name = m_serviceData.hostname_qualified;
-		m_serviceData.record_service.port = m_serviceData.port;
-		m_serviceData.record_service.weight = 0;
-		m_serviceData.record_service.priority = 0;
-
-		// A/AAAA record
-		m_serviceData.record_a.header.entry_string = m_serviceData.hostname_qualified;
-		m_serviceData.record_a.address_string = IPV4AddressToString(&m_serviceData.sockets_data.service_address_ipv4, sizeof(struct sockaddr_in));
-
-		m_serviceData.record_aaaa.header.entry_string = m_serviceData.hostname_qualified;
-		m_serviceData.record_aaaa.address_string = IPV6AddressToString(&m_serviceData.sockets_data.service_address_ipv6, sizeof(struct sockaddr_in));
-
-		// TXT record
-		m_serviceData.record_txt.header.entry_string = m_serviceData.service;
-
-		// create data struct for calls to the mdns lib
-		m_serviceDataForMdns.service = Convert(m_serviceData.service);
-		m_serviceDataForMdns.hostname = Convert(m_serviceData.hostname);
-		m_serviceDataForMdns.service_instance = Convert(m_serviceData.service_instance);
-		m_serviceDataForMdns.hostname_qualified = Convert(m_serviceData.hostname_qualified);
-		m_serviceDataForMdns.address_ipv4 = m_serviceData.sockets_data.service_address_ipv4;
-		m_serviceDataForMdns.address_ipv6 = m_serviceData.sockets_data.service_address_ipv6;
-		m_serviceDataForMdns.port = m_serviceData.port;
-
-		m_serviceDataForMdns.record_ptr = Convert(m_serviceData.record_ptr);
-		m_serviceDataForMdns.record_srv = Convert(m_serviceData.record_service);
-		m_serviceDataForMdns.record_a = Convert(m_serviceData.record_a);
-		// TODO: Actually convert to/from the address type stored in mdns_cpp::ARecord/AAAARecord
-		m_serviceDataForMdns.record_a.data.a.addr = m_serviceData.sockets_data.service_address_ipv4;
-		m_serviceDataForMdns.record_aaaa = Convert(m_serviceData.record_aaaa);
-		m_serviceDataForMdns.record_aaaa.data.aaaa.addr = m_serviceData.sockets_data.service_address_ipv6;
-	
-		m_serviceDataForMdns.records_txt = Convert(m_serviceData.record_txt);
+		std::lock_guard<std::mutex> lock(m_settingsMutex);
+		for (const auto& socket : m_socketsData.sockets) {
+			mdns_socket_close(socket);
+		}
+		m_socketsData.sockets.clear();
+		m_multicastInterfaces.clear();
 	}
 
-	void Start()
+	std::shared_future<void> Start()
 	{
 #ifdef _WIN32
 		WinsockManager::Init();
@@ -137,102 +170,437 @@ public:
 		Log(LogLevel::Debug, "mDNS Service Start called.");
 		if (m_running.exchange(true, std::memory_order_acq_rel) == true) {
 			Log(LogLevel::Info, "mDNS Service already started.");
+			return m_ready;
+		}
+		// A previous start may have failed during setup, its thread has already exited
+		if (m_listenThread.joinable()) {
+			m_listenThread.join();
+		}
+
+		// Interface enumeration, socket setup and the announcements all happen on the listen thread
+		auto ready = std::make_shared<std::promise<void>>();
+		m_ready = ready->get_future().share();
+		m_listenThread = std::thread([this, ready](){
+			try {
+				Setup();
+			} catch (...) {
+				// Stop() does nothing once m_running is false, so undo a partial setup here
+				CloseSockets();
+				std::atomic_store(&m_snapshot, std::shared_ptr<const ServiceSnapshot>());
+				m_running.store(false, std::memory_order_release);
+				ready->set_exception(std::current_exception());
+				return;
+			}
+			ready->set_value();
+			ListenLoop();
+		});
+		return m_ready;
+	}
+
+	void Stop()
+	{
+		const bool wasRunning = m_running.exchange(false, std::memory_order_acq_rel);
+
+		if (m_listenThread.joinable()) {
+			m_listenThread.join();
+		}
+
+		if (!wasRunning) {
 			return;
 		}
 
-		OpenSockets();
-		SetupData();
+		Log(LogLevel::Info, "mDNS Service stopping.");
 
-		// Send an announcement on startup of service
+		if (!m_cacheSnapshotPath.empty()) {
+			RecordCache::GetInstance().SaveSnapshot(m_cacheSnapshotPath);
+		}
+
+		// Say goodbye for the latest records, including any update the listen thread did not get to
+		std::shared_ptr<const ServiceSnapshot> snapshot;
 		{
-			Log(LogLevel::Info, "mDNS Service sending announce.");
-			std::vector<mdns_record_t> additional;
-			additional.push_back(m_serviceDataForMdns.record_srv);
-			if (m_serviceDataForMdns.address_ipv4.sin_family == AF_INET) {
-				additional.push_back(m_serviceDataForMdns.record_a);
-			}
-			if (m_serviceDataForMdns.address_ipv6.sin6_family == AF_INET6) {
-				additional.push_back(m_serviceDataForMdns.record_aaaa);
+			std::lock_guard<std::mutex> lock(m_settingsMutex);
+			snapshot = m_pendingSnapshot ? std::move(m_pendingSnapshot) : std::atomic_load(&m_snapshot);
+			m_pendingSnapshot.reset();
+			std::atomic_store(&m_snapshot, std::shared_ptr<const ServiceSnapshot>());
+		}
+
+		// Send a goodbye on end of service
+		if (snapshot) {
+			std::vector<char> buffer(snapshot->mdns.max_packet_size);
+
+			SendOnInterfaces(*snapshot, [&buffer](int socket, const service_t& mdns) {
+				const auto additional = AdditionalRecords(mdns);
+				GoodbyeMulticast(socket, buffer.data(), buffer.size(), mdns.record_ptr, additional.data(), additional.size());
+			});
+		}
+
+		CloseSockets();
+
+		Log(LogLevel::Info, "DNS service stopped.");
+	}
+
+	[[nodiscard]] bool Started() const {
+		return m_running.load(std::memory_order_acquire);
+	}
+
+	void FlushAnswers()
+	{
+		m_flushAnswers.store(true, std::memory_order_release);
+	}
+
+	[[nodiscard]] std::uint64_t ThrottledQueries() const {
+		return m_throttledQueries.load(std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] const ServiceLatency& Latency() const {
+		return m_latency;
+	}
+
+protected:
+	// Applies a settings change. While running, a new snapshot is built here on the caller's
+	// thread and handed to the listen thread, which swaps it in and announces the difference
+	template <typename Modify>
+	void Update(Modify&& modify)
+	{
+		std::lock_guard<std::mutex> lock(m_settingsMutex);
+		modify(m_serviceSettings);
+		if (std::atomic_load(&m_snapshot)) {
+			if (m_serviceSettings.service_name.empty()) {
+				Log(LogLevel::Error, "Empty service name, update not applied to the running service.");
+				return;
 			}
+			m_pendingSnapshot = BuildSnapshot(m_serviceSettings, m_socketsData);
+		}
+	}
 
-			std::array<char, 2048> buffer;
-			for (const auto& socket : m_serviceData.sockets_data.sockets) {
-				mdns_announce_multicast(socket, buffer.data(), buffer.size(), m_serviceDataForMdns.record_ptr, nullptr, 0, additional.data(), additional.size());
+	static void RemoveMatching(std::vector<Record>& records, const DomainName& name, std::uint16_t type)
+	{
+		records.erase(std::remove_if(records.begin(), records.end(), [&name, type](const Record& record) {
+			return RecordTypeOf(record) == type && GetHeader(record).entry_string == name;
+		}), records.end());
+	}
+
+	// Records sent along with the PTR record in announcements and goodbyes
+	static std::vector<mdns_record_t> AdditionalRecords(const service_t& mdns)
+	{
+		std::vector<mdns_record_t> additional;
+		additional.push_back(mdns.record_srv);
+		if (mdns.address_ipv4.sin_family == AF_INET) {
+			additional.push_back(mdns.record_a);
+		}
+		if (mdns.address_ipv6.sin6_family == AF_INET6) {
+			additional.push_back(mdns.record_aaaa);
+		}
+		additional.insert(additional.end(), mdns.records_txt.begin(), mdns.records_txt.end());
+		additional.insert(additional.end(), mdns.records_extra.begin(), mdns.records_extra.end());
+		return additional;
+	}
+
+	// A/AAAA records of our hostname carry the address of the interface they are sent on
+	static std::vector<mdns_record_t> WithInterfaceAddresses(std::vector<mdns_record_t> records, const service_t& mdns)
+	{
+		const std::string_view hostname(mdns.hostname_qualified.str, mdns.hostname_qualified.length);
+		for (auto& record : records) {
+			if (!NameEquals(record.name, hostname)) {
+				continue;
+			}
+			if (record.type == MDNS_RECORDTYPE_A && mdns.address_ipv4.sin_family == AF_INET) {
+				record.data.a.addr = mdns.address_ipv4;
+			} else if (record.type == MDNS_RECORDTYPE_AAAA && mdns.address_ipv6.sin6_family == AF_INET6) {
+				record.data.aaaa.addr = mdns.address_ipv6;
 			}
 		}
+		return records;
+	}
 
-		m_listenThread = std::thread([this](){
-			ListenLoop();
-		});
+	// Makes multicast sends on <socket> go out <iface>, skipping the call if they already do
+	void SelectInterface(int socket, const InterfaceAddress& iface)
+	{
+		auto& current = m_multicastInterfaces[socket];
+		if (current != iface.index) {
+			SetMulticastInterface(socket, iface);
+			current = iface.index;
+		}
 	}
 
-	void Stop()
+	// Calls send(socket, mdns) for every socket. Where the arrival interface of queries is known,
+	// that is once per interface of the socket's address family, sent out that interface and
+	// with its addresses. Otherwise once, out the default multicast interface
+	template <typename Send>
+	void SendOnInterfaces(const ServiceSnapshot& snapshot, Send&& send)
 	{
-		if (m_running.exchange(false, std::memory_order_acq_rel) == false){
-			// Was not running previously!
+		for (const auto& socket : m_socketsData.sockets) {
+			if (snapshot.interface_views.empty()) {
+				send(socket, snapshot.mdns);
+				continue;
+			}
+			const int family = SocketFamily(socket);
+			for (const auto& view : snapshot.interface_views) {
+				const InterfaceAddress* iface = (family == AF_INET) ? view.ipv4 : view.ipv6;
+				if (iface) {
+					SelectInterface(socket, *iface);
+					send(socket, view.mdns);
+				}
+			}
+		}
+	}
+
+	// Swap in a pending snapshot if there is one, and announce only what changed
+	void ApplyPendingUpdate()
+	{
+		std::shared_ptr<const ServiceSnapshot> next;
+		{
+			std::lock_guard<std::mutex> lock(m_settingsMutex);
+			next = std::move(m_pendingSnapshot);
+			m_pendingSnapshot.reset();
+		}
+		if (!next) {
+			return;
+		}
+		const auto previous = std::atomic_load(&m_snapshot);
+		std::atomic_store(&m_snapshot, next);
+
+		const auto oldRecords = previous->AnnouncedRecords();
+		const auto newRecords = next->AnnouncedRecords();
+		const auto contains = [](const std::vector<Record>& records, const Record& record) {
+			return std::find(records.begin(), records.end(), record) != records.end();
+		};
+
+		// New or changed records are announced, unique records with the cache-flush bit replace
+		// the old data in caches. Goodbyes are only needed for records that are gone entirely,
+		// and for shared PTR records, which are never flushed
+		std::vector<Record> announce;
+		for (const auto& record : newRecords) {
+			if (!contains(oldRecords, record)) {
+				announce.push_back(record);
+			}
+		}
+		std::vector<Record> goodbye;
+		for (const auto& record : oldRecords) {
+			if (contains(newRecords, record)) {
+				continue;
+			}
+			const auto type = RecordTypeOf(record);
+			const bool replaced = (type != MDNS_RECORDTYPE_PTR) &&
+			    std::any_of(newRecords.begin(), newRecords.end(), [&record, type](const Record& other) {
+				    return RecordTypeOf(other) == type && GetHeader(other).entry_string == GetHeader(record).entry_string;
+			    });
+			if (!replaced) {
+				goodbye.push_back(record);
+			}
+		}
+		if (announce.empty() && goodbye.empty()) {
 			return;
 		}
+		Log(LogLevel::Info, fmt::format("mDNS Service update: announcing {} record{}, goodbye for {}.", announce.size(), announce.size() == 1 ? "" : "s", goodbye.size()));
 
-		Log(LogLevel::Info, "mDNS Service stopping.");
+		const auto toMdns = [](const std::vector<Record>& records) {
+			std::vector<mdns_record_t> out;
+			for (const auto& record : records) {
+				const auto converted = Convert(record);
+				out.insert(out.end(), converted.begin(), converted.end());
+			}
+			return out;
+		};
+		const auto announceMdns = toMdns(announce);
+		const auto goodbyeMdns = toMdns(goodbye);
+
+		std::vector<char> buffer(next->mdns.max_packet_size);
+		SendOnInterfaces(*next, [&](int socket, const service_t& mdns) {
+			if (!goodbyeMdns.empty()) {
+				const auto records = WithInterfaceAddresses(goodbyeMdns, mdns);
+				GoodbyeRecords(socket, buffer.data(), buffer.size(), records.data(), records.size());
+			}
+			if (!announceMdns.empty()) {
+				const auto records = WithInterfaceAddresses(announceMdns, mdns);
+				AnnounceRecords(socket, buffer.data(), buffer.size(), records.data(), records.size());
+			}
+		});
+	}
 
-		if (m_listenThread.joinable()) {
-			m_listenThread.join();
+	// Runs on the listen thread before it starts answering
+	void Setup()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_settingsMutex);
+			if (m_serviceSettings.service_name.empty()) {
+				Log(LogLevel::Error, "Empty service name.");
+				throw std::runtime_error("Empty service name.");
+			}
 		}
 
-		// Send a goodbye on end of service
+		OpenSockets();
+
+		std::shared_ptr<const ServiceSnapshot> snapshot;
 		{
-			std::vector<mdns_record_t> additional;
-			additional.push_back(m_serviceDataForMdns.record_srv);
-			if (m_serviceDataForMdns.address_ipv4.sin_family == AF_INET) {
-				additional.push_back(m_serviceDataForMdns.record_a);
+			std::lock_guard<std::mutex> lock(m_settingsMutex);
+			snapshot = BuildSnapshot(m_serviceSettings, m_socketsData);
+			m_pendingSnapshot.reset();
+			std::atomic_store(&m_snapshot, snapshot);
+			m_announcementsLeft = m_serviceSettings.announce_count;
+			m_cacheSnapshotPath = m_serviceSettings.cache_snapshot_path;
+			m_cacheSnapshotInterval = m_serviceSettings.cache_snapshot_interval;
+			m_rateLimiter.reset();
+			if (m_serviceSettings.query_rate_limit > 0) {
+				m_rateLimiter = std::make_unique<RateLimiter>(m_serviceSettings.query_rate_limit, m_serviceSettings.query_burst,
+				                                              m_serviceSettings.rate_limit_sources, m_throttledQueries);
 			}
-			if (m_serviceDataForMdns.address_ipv6.sin6_family == AF_INET6) {
-				additional.push_back(m_serviceDataForMdns.record_aaaa);
+			m_answerCache.reset();
+			if (m_serviceSettings.answer_provider) {
+				m_answerCache = std::make_unique<AnswerCache>(m_serviceSettings.answer_provider, m_serviceSettings.negative_answer_ttl,
+				                                              m_serviceSettings.answer_cache_size);
 			}
+		}
+		Log(LogLevel::Info, fmt::format("Service mDNS: {}:{}", snapshot->service, snapshot->port));
+		Log(LogLevel::Info, fmt::format("Hostname: {}", snapshot->hostname));
 
-			std::array<char, 2048> buffer;
+		m_nextAnnouncement = std::chrono::steady_clock::now();
+		m_announcementInterval = std::chrono::seconds(1);
 
-			for (const auto& socket : m_serviceData.sockets_data.sockets) {
-				mdns_goodbye_multicast(socket, buffer.data(), buffer.size(), m_serviceDataForMdns.record_ptr, nullptr, 0, additional.data(), additional.size());
-			}
+		if (!m_cacheSnapshotPath.empty()) {
+			RecordCache::GetInstance().LoadSnapshot(m_cacheSnapshotPath);
+			RefreshCache(*snapshot);
+			m_nextCacheSnapshot = m_nextAnnouncement + m_cacheSnapshotInterval;
 		}
+	}
 
-		for (const auto& socket : m_serviceData.sockets_data.sockets) {
-			mdns_socket_close(socket);
+	// Query for everything loaded from the snapshot, the answers are snooped into the cache
+	// and confirm (or, with the cache-flush bit, replace) the loaded records
+	void RefreshCache(const ServiceSnapshot& snapshot)
+	{
+		const auto unconfirmed = RecordCache::GetInstance().Unconfirmed();
+		if (unconfirmed.empty()) {
+			return;
 		}
-		m_serviceData.sockets_data.sockets.clear();
+		Log(LogLevel::Info, fmt::format("mDNS Service refreshing {} cached name{}.", unconfirmed.size(), unconfirmed.size() == 1 ? "" : "s"));
 
-		Log(LogLevel::Info, "DNS service stopped.");
+		std::vector<Question> questions;
+		questions.reserve(unconfirmed.size());
+		for (const auto& [name, type] : unconfirmed) {
+			questions.push_back({name.view(), static_cast<std::uint16_t>(type), MDNS_CLASS_IN});
+		}
+		std::vector<char> buffer(snapshot.mdns.max_packet_size);
+		SendOnInterfaces(snapshot, [&](int socket, const service_t&) {
+			SendQuestions(socket, nullptr, 0, buffer.data(), buffer.size(), 0, questions.data(), questions.size());
+		});
 	}
 
-	[[nodiscard]] bool Started() const {
-		return m_running.load(std::memory_order_acquire);
+	void SaveCacheIfDue()
+	{
+		if (m_cacheSnapshotPath.empty() || m_cacheSnapshotInterval.count() == 0 ||
+		    std::chrono::steady_clock::now() < m_nextCacheSnapshot) {
+			return;
+		}
+		RecordCache::GetInstance().SaveSnapshot(m_cacheSnapshotPath);
+		m_nextCacheSnapshot = std::chrono::steady_clock::now() + m_cacheSnapshotInterval;
+	}
+
+	// RFC 6762 8.3: announce at least twice, one second apart, doubling the interval each time.
+	// With the default announce_count of 3 that is at 0s, 1s and 3s after startup
+	void AnnounceIfDue()
+	{
+		if (m_announcementsLeft == 0 || std::chrono::steady_clock::now() < m_nextAnnouncement) {
+			return;
+		}
+		const auto snapshot = std::atomic_load(&m_snapshot);
+		Log(LogLevel::Info, "mDNS Service sending announce.");
+
+		std::vector<char> buffer(snapshot->mdns.max_packet_size);
+		SendOnInterfaces(*snapshot, [&buffer](int socket, const service_t& mdns) {
+			const auto additional = AdditionalRecords(mdns);
+			AnnounceMulticast(socket, buffer.data(), buffer.size(), mdns.record_ptr, additional.data(), additional.size());
+		});
+
+		--m_announcementsLeft;
+		m_nextAnnouncement += m_announcementInterval;
+		m_announcementInterval *= 2;
+	}
+
+	// How long select() may block before the next scheduled announcement
+	struct timeval PollTimeout() const
+	{
+		auto wait = std::chrono::microseconds(100000);
+		if (m_announcementsLeft > 0) {
+			const auto untilAnnouncement = std::chrono::duration_cast<std::chrono::microseconds>(m_nextAnnouncement - std::chrono::steady_clock::now());
+			wait = std::max(std::chrono::microseconds(0), std::min(wait, untilAnnouncement));
+		}
+		struct timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = static_cast<long>(wait.count());
+		return timeout;
+	}
+
+	// Answers go out the interface a query arrived on, with that interface's addresses.
+	// trace is filled in when latency tracing is on
+	ListenContext ArrivalContext(int socket, const ServiceSnapshot& snapshot, PacketTrace& trace)
+	{
+		ListenContext context;
+		context.service = &snapshot.mdns;
+		context.limiter = m_rateLimiter.get();
+		context.answers = m_answerCache.get();
+		if (m_latencyTracing) {
+			trace.latency = &m_latency;
+			trace.pickup = std::chrono::steady_clock::now();
+			context.trace = &trace;
+		}
+		if (!m_socketsData.packet_info && !m_receiveTimestamps) {
+			return context;
+		}
+		const PacketInfo info = PeekPacketInfo(socket);
+		if (m_latencyTracing && info.receive_time_ns != 0) {
+			trace.queueing = std::chrono::nanoseconds(std::max<std::int64_t>(0, RealtimeNs() - info.receive_time_ns));
+			m_latency.queueing.Record(*trace.queueing);
+		}
+		if (!info.valid || !m_socketsData.packet_info) {
+			return context;
+		}
+		context.direct = !MulticastDestination(info);
+		if (const auto* view = snapshot.FindInterface(info.interface_index)) {
+			const InterfaceAddress* iface = (info.destination.ss_family == AF_INET) ? view->ipv4 : view->ipv6;
+			if (iface) {
+				SelectInterface(socket, *iface);
+				context.service = &view->mdns;
+			}
+		}
+		return context;
 	}
 
-protected:
 	void ListenLoop()
 	{
+		// Big enough for any mDNS packet (RFC 6762 17)
+		std::array<char, kMaxPacketSize> buffer;
+
 		// This is a crude implementation that checks for incoming queries
 		while (m_running.load(std::memory_order_acquire)) {
+			AnnounceIfDue();
+			ApplyPendingUpdate();
+			SaveCacheIfDue();
+
 			int nfds = 0;
 			fd_set readfs;
 			FD_ZERO(&readfs);
-			for (const auto& sock : m_serviceData.sockets_data.sockets) {
+			for (const auto& sock : m_socketsData.sockets) {
 				if (sock >= nfds)
 					nfds = sock + 1;
 				FD_SET(sock, &readfs);
 			}
 
-			struct timeval timeout;
-			timeout.tv_sec = 0;
-			timeout.tv_usec = 100000;
+			struct timeval timeout = PollTimeout();
 
-			std::array<char, 2048> buffer;
 			if (select(nfds, &readfs, nullptr, nullptr, &timeout) >= 0) {
-				for (const auto& sock : m_serviceData.sockets_data.sockets) {
+				if (m_flushAnswers.exchange(false, std::memory_order_acq_rel) && m_answerCache) {
+					m_answerCache->Clear();
+				}
+				// Hold a reference so the snapshot stays alive while the callback uses it
+				const auto snapshot = std::atomic_load(&m_snapshot);
+				for (const auto& sock : m_socketsData.sockets) {
 					if (FD_ISSET(sock, &readfs)) {
-						mdns_socket_listen(sock, buffer.data(), buffer.size(), ServiceCallback,
-										&m_serviceDataForMdns);
+						PacketTrace trace;
+						ListenContext context = ArrivalContext(sock, *snapshot, trace);
+						mdns_socket_listen(sock, buffer.data(), buffer.size(), ServiceCallback, &context);
+						if (context.trace && trace.parsed) {
+							m_latency.total.Record(std::chrono::steady_clock::now() - trace.pickup + trace.queueing.value_or(std::chrono::nanoseconds(0)));
+						}
 					}
 					FD_SET(sock, &readfs);
 				}
@@ -241,7 +609,6 @@ protected:
 			}
 		}
 	}
-
 };
 
 Service::Service(ServiceSettings settings)
@@ -255,9 +622,39 @@ void Service::SetSettings(ServiceSettings settings)
 	m_impl->SetSettings(std::move(settings));
 }
 
-void Service::Start()
+void Service::UpdateTxt(TxtData txt)
+{
+	m_impl->UpdateTxt(std::move(txt));
+}
+
+void Service::SetTxtValue(std::string_view key, std::string_view value)
 {
-	m_impl->Start();
+	m_impl->SetTxtValue(key, value);
+}
+
+void Service::RemoveTxtValue(std::string_view key)
+{
+	m_impl->RemoveTxtValue(key);
+}
+
+void Service::UpdatePort(std::uint16_t port)
+{
+	m_impl->UpdatePort(port);
+}
+
+void Service::AddRecord(Record record)
+{
+	m_impl->AddRecord(std::move(record));
+}
+
+void Service::RemoveRecord(const DomainName& name, RecordType type)
+{
+	m_impl->RemoveRecord(name, type);
+}
+
+std::shared_future<void> Service::Start()
+{
+	return m_impl->Start();
 }
 
 void Service::Stop()
@@ -270,5 +667,20 @@ bool Service::Started() const
 	return m_impl->Started();
 }
 
+void Service::FlushAnswers()
+{
+	m_impl->FlushAnswers();
+}
+
+std::uint64_t Service::ThrottledQueries() const
+{
+	return m_impl->ThrottledQueries();
+}
+
+const ServiceLatency& Service::Latency() const
+{
+	return m_impl->Latency();
+}
+
 
-}
\ No newline at end of file
+}
@@ -1,81 +1,1000 @@
 #include "mdns_cpp/service_discovery.hpp"
 #include "mdns.h"
 #include "mdns_utils.hpp"
+#include "host_cache.hpp"
+#include "packet_reader.hpp"
+#include "mdns_cpp/record_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <fmt/ostream.h>
 
 namespace mdns_cpp
 {
 
-// Mostly from send_dns_sd()
-std::vector<Record> RunServiceDiscovery()
+namespace
 {
-#ifdef _WIN32
-	if (!WinsockManager::Init()) {
-		return {};
+
+constexpr std::string_view kDnsSdServices = "_services._dns-sd._udp.local.";
+
+// ServiceBrowser query backoff (RFC 6762 5.2)
+constexpr std::chrono::seconds kFirstQueryInterval{1};
+constexpr std::chrono::minutes kMaxQueryInterval{60};
+// How often the browser drops expired instances when nothing arrives
+constexpr std::chrono::seconds kPurgeInterval{1};
+// Cache maintenance queries at 80%, 85%, 90% and 95% of a record's TTL, each up to 2% later at
+// random (RFC 6762 5.2)
+constexpr int kRefreshPercent = 80;
+constexpr int kRefreshStepPercent = 5;
+constexpr int kRefreshSteps = 4;
+constexpr int kRefreshJitterPercent = 2;
+
+struct DiscoveryContext
+{
+	const DiscoveryOptions& options;
+	// Every record received, nullptr to not keep them
+	std::vector<Record>* records;
+	std::chrono::steady_clock::time_point sendTime;
+	// Every record received as rows of a table instead, nullptr to not keep them
+	RecordTable* table{nullptr};
+	// Answers are only taken from senders on the link of one of these (RFC 6762 11), unicast
+	// answers to QU queries could come from anywhere. nullptr to take everything
+	const std::vector<InterfaceAddress>* interfaces{nullptr};
+	std::size_t offlink{0};
+	// With a service type filter: instances and hosts of the services that matched so far
+	std::vector<DomainName> instances{};
+	std::vector<DomainName> hosts{};
+	std::size_t dropped{0};
+};
+
+bool Contains(const std::vector<DomainName>& names, std::string_view name)
+{
+	return std::any_of(names.begin(), names.end(), [name](const DomainName& known) { return known == name; });
+}
+
+// Whether a record belongs to a service matching options.service_types. Decided on the raw packet,
+// before anything is parsed into a Record. PTR records are matched on the service type, SRV and
+// TXT records on the instance's type or a PTR that matched earlier, A/AAAA on the target of a
+// matching SRV record (responders send these after the SRV record)
+bool Accept(DiscoveryContext& context, uint16_t rtype, const void* data, size_t size, size_t name_offset,
+            size_t record_offset, size_t record_length)
+{
+	const BrowseFilter& filter = context.options.service_types;
+	char namebuffer[256];
+	const mdns_string_t owner = mdns_string_extract(data, size, &name_offset, namebuffer, sizeof(namebuffer));
+	const std::string_view name(owner.str, owner.length);
+
+	if (rtype == MDNS_RECORDTYPE_PTR) {
+		char targetbuffer[256];
+		const mdns_string_t target = mdns_record_parse_ptr(data, size, record_offset, record_length, targetbuffer, sizeof(targetbuffer));
+		const std::string_view targetName(target.str, target.length);
+		if (NameEquals(owner, kDnsSdServices)) {
+			// Service type enumeration, the target is the type
+			return filter.Matches(targetName);
+		}
+		if (!filter.Matches(name)) {
+			return false;
+		}
+		if (!Contains(context.instances, targetName)) {
+			context.instances.emplace_back(targetName);
+		}
+		return true;
+	}
+	if (rtype == MDNS_RECORDTYPE_SRV || rtype == MDNS_RECORDTYPE_TXT) {
+		const auto dot = name.find('.');
+		const bool matches = Contains(context.instances, name) ||
+		                     (dot != std::string_view::npos && filter.Matches(name.substr(dot + 1)));
+		if (matches && rtype == MDNS_RECORDTYPE_SRV) {
+			char targetbuffer[256];
+			const mdns_record_srv_t srv = mdns_record_parse_srv(data, size, record_offset, record_length, targetbuffer, sizeof(targetbuffer));
+			const std::string_view host(srv.name.str, srv.name.length);
+			if (!Contains(context.hosts, host)) {
+				context.hosts.emplace_back(host);
+			}
+		}
+		return matches;
+	}
+	if (rtype == MDNS_RECORDTYPE_A || rtype == MDNS_RECORDTYPE_AAAA) {
+		return Contains(context.hosts, name);
+	}
+	return false;
+}
+
+// Hands a received record to everything in <options> that wants it. Records from a transport
+// stay out of the process-wide RecordCache, they are not from the network
+void Deliver(const DiscoveryOptions& options, const Record& record)
+{
+	if (!options.transport) {
+		RecordCache::GetInstance().Insert(record);
+	}
+	if (options.instances) {
+		options.instances->Insert(record);
+	}
+	if (options.on_record) {
+		options.on_record(record);
+	}
+	if (options.record_queue) {
+		options.record_queue->Push(record);
+	}
+	Log(LogLevel::Debug, fmt::format("Got record: {}", record));
+}
+
+int DiscoveryCallback(int sock, const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+                      uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
+                      size_t size, size_t name_offset, size_t name_length, size_t record_offset,
+                      size_t record_length, void* user_data)
+{
+	auto& context = *static_cast<DiscoveryContext*>(user_data);
+	const DiscoveryOptions& options = context.options;
+	if (context.interfaces && !context.interfaces->empty() && !FromInterface(from, *context.interfaces)) {
+		++context.offlink;
+		return 0;
+	}
+	if (!options.service_types.Empty() &&
+	    !Accept(context, rtype, data, size, name_offset, record_offset, record_length)) {
+		++context.dropped;
+		return 0;
+	}
+
+	Record record;
+	QueryCallback(sock, from, addrlen, entry, query_id, rtype, rclass, ttl, data, size, name_offset,
+	              name_length, record_offset, record_length, &record);
+
+	if (options.response_latency) {
+		options.response_latency->Record(std::chrono::steady_clock::now() - context.sendTime);
 	}
+	Deliver(options, record);
+	if (context.table) {
+		context.table->Append(record);
+	}
+	if (context.records) {
+		context.records->push_back(std::move(record));
+	}
+	return 0;
+}
+
+// The question class, with the QU bit set to ask for a unicast answer
+uint16_t QuestionClass(bool unicast)
+{
+	const uint16_t rclass = MDNS_CLASS_IN;
+	return static_cast<uint16_t>(unicast ? (rclass | MDNS_UNICAST_RESPONSE) : rclass);
+}
+
+// Browse the wanted types directly when they are all spelled out, else enumerate every type
+std::vector<Question> BrowseQuestions(const DiscoveryOptions& options, bool unicast)
+{
+	std::vector<Question> questions;
+	if (!options.service_types.Empty() && options.service_types.Literal()) {
+		for (const auto& type : options.service_types.Patterns()) {
+			questions.push_back({type, MDNS_RECORDTYPE_PTR, QuestionClass(unicast)});
+		}
+	} else {
+		questions.push_back({kDnsSdServices, MDNS_RECORDTYPE_PTR, QuestionClass(unicast)});
+	}
+	return questions;
+}
+
+struct BatchContext
+{
+	const DiscoveryOptions& options;
+	const std::vector<InterfaceAddress>& interfaces;
+	std::vector<QueryResult>& results;
+	// Query name -> indices into results, answers are routed on the name before being parsed
+	std::unordered_map<DomainName, std::vector<std::size_t>> routes{};
+	// Queries for unique records still without an answer
+	std::size_t unanswered{0};
+	std::chrono::steady_clock::time_point sendTime{};
+};
+
+bool Answers(const Query& query, uint16_t rtype)
+{
+	return query.type == RecordType::ANY || static_cast<uint16_t>(query.type) == rtype;
+}
+
+bool Shared(RecordType type)
+{
+	return type == RecordType::PTR || type == RecordType::ANY;
+}
+
+int BatchCallback(int sock, const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+                  uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
+                  size_t size, size_t name_offset, size_t name_length, size_t record_offset,
+                  size_t record_length, void* user_data)
+{
+	auto& context = *static_cast<BatchContext*>(user_data);
+	if (entry == MDNS_ENTRYTYPE_QUESTION ||
+	    (!context.interfaces.empty() && !FromInterface(from, context.interfaces))) {
+		return 0;
+	}
+	char namebuffer[256];
+	size_t offset = name_offset;
+	const mdns_string_t owner = mdns_string_extract(data, size, &offset, namebuffer, sizeof(namebuffer));
+	const auto route = context.routes.find(DomainName(std::string_view(owner.str, owner.length)));
+	if (route == context.routes.end()) {
+		return 0;
+	}
+	const auto& indices = route->second;
+	if (std::none_of(indices.begin(), indices.end(), [&context, rtype](std::size_t i) { return Answers(context.results[i].query, rtype); })) {
+		return 0;
+	}
+
+	Record record;
+	QueryCallback(sock, from, addrlen, entry, query_id, rtype, rclass, ttl, data, size, name_offset,
+	              name_length, record_offset, record_length, &record);
+	if (context.options.response_latency) {
+		context.options.response_latency->Record(std::chrono::steady_clock::now() - context.sendTime);
+	}
+	// The same answer arrives once per interface it was sent out of
+	bool delivered = false;
+	for (const auto i : indices) {
+		auto& result = context.results[i];
+		if (!Answers(result.query, rtype) ||
+		    std::any_of(result.answers.begin(), result.answers.end(), [&record](const Record& known) { return SameRData(known, record); })) {
+			continue;
+		}
+		if (result.answers.empty() && !Shared(result.query.type)) {
+			--context.unanswered;
+		}
+		result.answers.push_back(record);
+		delivered = true;
+	}
+	if (delivered) {
+		Deliver(context.options, record);
+	}
+	return 0;
+}
+
+
+// The sockets a discovery call sends and receives on, or the endpoints of
+// DiscoveryOptions::transport. Closed again on destruction
+class ClientEndpoints
+{
+public:
+	explicit ClientEndpoints(const DiscoveryOptions& options)
+	: m_transport(options.transport.get())
+	{
+		if (m_transport) {
+			m_handles = m_transport->Open(false);
+			m_capacity = std::min(m_transport->MaxPacketSize(), kMaxPacketSize);
+			return;
+		}
+#ifdef _WIN32
+		if (!WinsockManager::Init()) {
+			return;
+		}
 #endif
-	const auto openedSocketData = OpenClientSockets(0);
-    const std::vector<int>& sockets = openedSocketData.sockets;
-    const int num_sockets = static_cast<int>(sockets.size());
-	if (sockets.empty()) {
+		m_socketsData = OpenClientSockets(0, 64, options.interfaces);
+		m_handles = m_socketsData.sockets;
+		m_capacity = PacketSizeForMtu(m_socketsData.mtu);
+	}
+
+	~ClientEndpoints()
+	{
+		for (const auto handle : m_handles) {
+			if (m_transport) {
+				m_transport->Close(handle);
+			} else {
+				mdns_socket_close(handle);
+			}
+		}
+	}
+
+	ClientEndpoints(const ClientEndpoints&) = delete;
+	ClientEndpoints& operator=(const ClientEndpoints&) = delete;
+
+	[[nodiscard]] const std::vector<int>& Handles() const { return m_handles; }
+	// Largest packet to send
+	[[nodiscard]] size_t Capacity() const { return m_capacity; }
+	// Interfaces the sockets are on, empty with a transport
+	[[nodiscard]] const std::vector<InterfaceAddress>& Interfaces() const { return m_socketsData.interfaces; }
+
+	[[nodiscard]] std::chrono::steady_clock::time_point Now() const
+	{
+		return m_transport ? m_transport->Now() : std::chrono::steady_clock::now();
+	}
+
+	// Calls send(handle) for every endpoint, whatever it sends goes out through the transport
+	template <typename Send>
+	void SendAll(Send&& send)
+	{
+		TransportScope scope(m_transport);
+		for (const auto handle : m_handles) {
+			send(handle);
+		}
+	}
+
+	// The endpoints with a packet waiting, after up to <timeout>. nullopt if waiting failed
+	std::optional<std::vector<int>> Wait(std::chrono::microseconds timeout)
+	{
+		if (m_transport) {
+			return m_transport->Wait(m_handles, timeout);
+		}
+		struct timeval tv;
+		tv.tv_sec = static_cast<long>(timeout.count() / 1000000);
+		tv.tv_usec = static_cast<long>(timeout.count() % 1000000);
+
+		int nfds = 0;
+		fd_set readfs;
+		FD_ZERO(&readfs);
+		for (const auto sock : m_handles) {
+			if (sock >= nfds)
+				nfds = sock + 1;
+			FD_SET(sock, &readfs);
+		}
+		if (select(nfds, &readfs, nullptr, nullptr, &tv) < 0) {
+			return std::nullopt;
+		}
+		std::vector<int> ready;
+		for (const auto sock : m_handles) {
+			if (FD_ISSET(sock, &readfs)) {
+				ready.push_back(sock);
+			}
+		}
+		return ready;
+	}
+
+	// How a packet is read: as mdns_discovery_recv() or as mdns_query_recv() does
+	enum class Read {
+		Discovery,
+		Query
+	};
+
+	// Reads one packet of <handle> and passes its records to <callback>, returns how many it had
+	size_t Receive(int handle, void* buffer, size_t capacity, Read read, mdns_record_callback_fn callback, void* user_data)
+	{
+		if (!m_transport) {
+			return (read == Read::Discovery) ? mdns_discovery_recv(handle, buffer, capacity, callback, user_data)
+			                                 : mdns_query_recv(handle, buffer, capacity, callback, user_data, 0);
+		}
+		struct sockaddr_storage from;
+		size_t from_size = sizeof(from);
+		const size_t size = m_transport->Receive(handle, buffer, capacity, from, from_size);
+		if (size == 0) {
+			return 0;
+		}
+		return ParsePacket(handle, reinterpret_cast<const struct sockaddr*>(&from), from_size, buffer, size, callback, user_data, true);
+	}
+
+private:
+	Transport* m_transport;
+	OpenSocketsData m_socketsData;
+	std::vector<int> m_handles;
+	size_t m_capacity{0};
+};
+
+// Mostly from send_dns_sd()
+// RunServiceDiscovery() into <records> and/or <table>
+void Discover(const DiscoveryOptions& options, std::vector<Record>* records, RecordTable* table)
+{
+	ClientEndpoints endpoints(options);
+	const auto num_sockets = endpoints.Handles().size();
+	if (num_sockets == 0) {
 		Log(LogLevel::Error, "Failed to open any client sockets");
-		return {};
+		return;
 	}
 
 	Log(LogLevel::Info, fmt::format("Opened {} socket{} for DNS Service Discovery.", num_sockets, num_sockets > 1 ? "s" : ""));
 	Log(LogLevel::Info, "Sending DNS-SD discovery.");
 
-	for (int isock = 0; isock < num_sockets; ++isock) {
-		if (mdns_discovery_send(sockets[isock])) {
+	// Big enough for any mDNS packet (RFC 6762 17)
+	std::array<uint8_t, kMaxPacketSize> buffer;
+	// A single query from ephemeral ports, so QU whenever asked for
+	const std::vector<Question> questions = BrowseQuestions(options, options.unicast_response);
+	const auto sendTime = std::chrono::steady_clock::now();
+	endpoints.SendAll([&](int sock) {
+		if (SendQuestions(sock, nullptr, 0, buffer.data(), endpoints.Capacity(), 0, questions.data(), questions.size())) {
 			Log(LogLevel::Info, fmt::format("Failed to send DNS-DS discovery: {}", strerror(errno)));
-        }
-	}
+		}
+	});
 
-	std::vector<Record> recordsOut;
-    std::array<uint8_t, 2048> buffer;
-	size_t num_records; // I have no idea what this is for as it does not 
+	DiscoveryContext context{options, records, sendTime};
+	context.table = table;
+	context.interfaces = &endpoints.Interfaces();
 
-	// This is a simple implementation that loops for <timeout> seconds or as long as we get replies
-	int numberOfReadyDescriptors;
+	// This is a simple implementation that loops for as long as we get replies, until there
+	// are none for a second
 	Log(LogLevel::Info, "Reading DNS-SD replies.");
-	do {
-		struct timeval timeout;
-		timeout.tv_sec = 1;
-		timeout.tv_usec = 0;
+	while (true) {
+		const auto ready = endpoints.Wait(std::chrono::seconds(1));
+		if (!ready || ready->empty()) {
+			break;
+		}
+		size_t num_records = 0;
+		for (const auto sock : *ready) {
+			num_records += endpoints.Receive(sock, buffer.data(), buffer.size(), ClientEndpoints::Read::Discovery, DiscoveryCallback, &context);
+		}
+		Log(LogLevel::Debug, fmt::format("Got {} records", num_records));
+	}
 
-		int nfds = 0;
-		fd_set readfs;
-		FD_ZERO(&readfs);
-		for (int isock = 0; isock < num_sockets; ++isock) {
-			if (sockets[isock] >= nfds)
-				nfds = sockets[isock] + 1;
-			FD_SET(sockets[isock], &readfs);
-		}
-
-		num_records = 0;
-		numberOfReadyDescriptors = select(nfds, &readfs, nullptr, nullptr, &timeout);
-		if (numberOfReadyDescriptors > 0) {
-			for (int isock = 0; isock < num_sockets; ++isock) {
-				if (FD_ISSET(sockets[isock], &readfs)) {
-					mdns_cpp::Record record;
-					num_records += mdns_discovery_recv(sockets[isock], buffer.data(), buffer.size(), QueryCallback,
-					                               &record);
-
-					recordsOut.push_back(record);
-					Log(LogLevel::Debug, fmt::format("Got record: {}", record));
+	if (context.dropped > 0) {
+		Log(LogLevel::Debug, fmt::format("Dropped {} records not matching the service types", context.dropped));
+	}
+	if (context.offlink > 0) {
+		Log(LogLevel::Debug, fmt::format("Dropped {} records from senders off the local link", context.offlink));
+	}
+}
+
+}
+
+std::vector<Record> RunServiceDiscovery(const DiscoveryOptions& options)
+{
+	std::vector<Record> records;
+	Discover(options, &records, nullptr);
+	return records;
+}
+
+std::size_t RunServiceDiscovery(RecordTable& table, const DiscoveryOptions& options)
+{
+	const std::size_t before = table.Size();
+	Discover(options, nullptr, &table);
+	return table.Size() - before;
+}
+
+
+std::optional<std::string> ResolveHost(const std::string& hostname, AddressFamily family, std::chrono::milliseconds timeout,
+                                       const DiscoveryOptions& options)
+{
+	if (hostname.empty()) {
+		return std::nullopt;
+	}
+	std::string name = hostname;
+	if (name.back() != '.') {
+		name += '.';
+	}
+	const uint16_t rtype = (family == AddressFamily::IPv6) ? MDNS_RECORDTYPE_AAAA : MDNS_RECORDTYPE_A;
+
+	// The process-wide caches hold what was seen on the network, a transport is asked every time
+	// and its answers are not cached
+	const bool cached = !options.transport;
+	auto& cache = HostCache::GetInstance();
+	if (const auto found = cached ? cache.Find(name, rtype) : std::nullopt) {
+		Log(LogLevel::Debug, fmt::format("Resolved {} from cache ({})", name, found->address ? *found->address : "negative"));
+		return found->address;
+	}
+	// Records snooped off the network by a running Service or left behind by discovery
+	const auto known = cached ? RecordCache::GetInstance().Find(name, static_cast<RecordType>(rtype)) : std::vector<Record>();
+	if (!known.empty()) {
+		const auto& record = known.front();
+		std::string address = (family == AddressFamily::IPv6) ? std::get<AAAARecord>(record).address_string : std::get<ARecord>(record).address_string;
+		Log(LogLevel::Debug, fmt::format("Resolved {} from record cache ({})", name, address));
+		return address;
+	}
+
+	// Sockets are bound to ephemeral ports, so with the QU bit responders answer us directly
+	// instead of multicasting to the whole segment
+	ClientEndpoints endpoints(options);
+	if (endpoints.Handles().empty()) {
+		Log(LogLevel::Error, "Failed to open any client sockets");
+		return std::nullopt;
+	}
+
+	std::array<uint8_t, kMaxPacketSize> buffer;
+	const Question question{name, rtype, QuestionClass(options.unicast_response)};
+	endpoints.SendAll([&](int sock) {
+		if (SendQuestions(sock, nullptr, 0, buffer.data(), endpoints.Capacity(), 0, &question, 1)) {
+			Log(LogLevel::Info, fmt::format("Failed to send mDNS query: {}", strerror(errno)));
+		}
+	});
+
+	HostQuery query;
+	query.hostname = name;
+	query.rtype = rtype;
+
+	// Return as soon as the first answer arrives instead of waiting out the timeout
+	const auto deadline = endpoints.Now() + timeout;
+	while (!query.address) {
+		const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - endpoints.Now());
+		if (remaining.count() <= 0) {
+			break;
+		}
+		const auto ready = endpoints.Wait(remaining);
+		if (!ready) {
+			break;
+		}
+		for (const auto sock : *ready) {
+			endpoints.Receive(sock, buffer.data(), buffer.size(), ClientEndpoints::Read::Query, ResolveCallback, &query);
+		}
+	}
+
+	if (!query.address) {
+		Log(LogLevel::Info, fmt::format("No answer for {} within {}ms", name, timeout.count()));
+	}
+	if (!cached) {
+		return query.address;
+	}
+	if (query.address) {
+		cache.InsertPositive(name, rtype, *query.address, query.ttl);
+	} else {
+		cache.InsertNegative(name, rtype);
+	}
+	return query.address;
+}
+
+
+std::vector<QueryResult> RunQueries(const std::vector<Query>& queries, std::chrono::milliseconds timeout,
+                                   const DiscoveryOptions& options)
+{
+	std::vector<QueryResult> results;
+	results.reserve(queries.size());
+	for (const auto& query : queries) {
+		results.push_back({query, {}});
+	}
+	if (queries.empty()) {
+		return results;
+	}
+	ClientEndpoints endpoints(options);
+	if (endpoints.Handles().empty()) {
+		Log(LogLevel::Error, "Failed to open any client sockets");
+		return results;
+	}
+
+	BatchContext context{options, endpoints.Interfaces(), results};
+	std::vector<Question> questions;
+	bool shared = false;
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		const Query& query = results[i].query;
+		auto& route = context.routes[query.name];
+		const bool asked = std::any_of(route.begin(), route.end(), [&results, &query](std::size_t j) { return results[j].query.type == query.type; });
+		route.push_back(i);
+		shared = shared || Shared(query.type);
+		if (!Shared(query.type)) {
+			++context.unanswered;
+		}
+		if (!asked) {
+			// Points into results, which is not resized from here on
+			questions.push_back({query.name.view(), static_cast<uint16_t>(query.type), QuestionClass(options.unicast_response)});
+		}
+	}
+
+	std::array<uint8_t, kMaxPacketSize> buffer;
+	context.sendTime = std::chrono::steady_clock::now();
+	endpoints.SendAll([&](int sock) {
+		if (SendQuestions(sock, nullptr, 0, buffer.data(), endpoints.Capacity(), 0, questions.data(), questions.size())) {
+			Log(LogLevel::Info, fmt::format("Failed to send mDNS queries: {}", strerror(errno)));
+		}
+	});
+	Log(LogLevel::Debug, fmt::format("Sent {} questions for {} queries", questions.size(), queries.size()));
+
+	const auto deadline = endpoints.Now() + timeout;
+	while (shared || context.unanswered > 0) {
+		const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - endpoints.Now());
+		if (remaining.count() <= 0) {
+			break;
+		}
+		const auto ready = endpoints.Wait(remaining);
+		if (!ready) {
+			break;
+		}
+		for (const auto sock : *ready) {
+			endpoints.Receive(sock, buffer.data(), buffer.size(), ClientEndpoints::Read::Query, BatchCallback, &context);
+		}
+	}
+
+	if (context.unanswered > 0) {
+		Log(LogLevel::Info, fmt::format("{} of {} queries unanswered within {}ms", context.unanswered, queries.size(), timeout.count()));
+	}
+	return results;
+}
+
+class ServiceBrowser::BrowserImpl
+{
+private:
+	DiscoveryOptions m_options;
+	std::shared_ptr<InstanceTable> m_instances;
+
+	std::atomic<bool> m_running{false};
+	std::thread m_browseThread;
+
+	// Only touched by the browse thread while it runs
+	OpenSocketsData m_socketsData;
+	// The questions for the first query and the ones after it, see DiscoveryOptions::unicast_response
+	std::vector<Question> m_firstQuestions;
+	std::vector<Question> m_questions;
+	// Service types learned from the type enumeration, browsed on top of m_questions
+	std::vector<DomainName> m_types;
+	std::vector<DomainName> m_newTypes;
+
+	// A record the browser keeps alive with cache maintenance queries, keyed by RefreshKey()
+	struct Refresh
+	{
+		DomainName name; // the question that refreshes it
+		uint16_t type;
+		std::chrono::steady_clock::time_point received;
+		std::chrono::seconds ttl;
+	};
+	// The next maintenance query of a record. Stale once the record was received again or said
+	// goodbye, which is checked when it comes up
+	struct RefreshDue
+	{
+		std::chrono::steady_clock::time_point when;
+		std::string key;
+		std::chrono::steady_clock::time_point received;
+		int step;
+		bool operator>(const RefreshDue& other) const { return when > other.when; }
+	};
+	std::unordered_map<std::string, Refresh> m_refresh;
+	std::priority_queue<RefreshDue, std::vector<RefreshDue>, std::greater<RefreshDue>> m_refreshDue;
+	// Hosts of the instances being refreshed, their addresses are refreshed too
+	std::unordered_set<DomainName> m_refreshHosts;
+	std::minstd_rand m_random{std::random_device()()};
+
+public:
+	BrowserImpl(DiscoveryOptions options)
+	: m_options(std::move(options))
+	{
+		if (!m_options.instances) {
+			m_options.instances = std::make_shared<InstanceTable>();
+		}
+		m_instances = m_options.instances;
+		m_options.response_latency = nullptr;
+		// Types announced in answer to the type enumeration are browsed in turn, for the
+		// instances. Runs on the browse thread from DiscoveryCallback
+		m_options.on_record = [this, on_record = std::move(m_options.on_record)](const Record& record) {
+			const auto* ptr = std::get_if<DomainNamePointerRecord>(&record);
+			if (ptr && ptr->header.ttl > 0 && ptr->header.entry_string == kDnsSdServices &&
+			    std::find(m_types.begin(), m_types.end(), ptr->name_string) == m_types.end()) {
+				m_types.push_back(ptr->name_string);
+				m_newTypes.push_back(ptr->name_string);
+			}
+			Track(record);
+			if (on_record) {
+				on_record(record);
+			}
+		};
+	}
+
+	~BrowserImpl()
+	{
+		Stop();
+	}
+
+	void Start()
+	{
+#ifdef _WIN32
+		WinsockManager::Init();
+#endif
+		if (m_running.exchange(true, std::memory_order_acq_rel) == true) {
+			Log(LogLevel::Info, "Service browser already started.");
+			return;
+		}
+		// Bound to the mDNS port, so multicast announcements and goodbyes arrive here too
+		m_socketsData = OpenServiceSockets(m_options.interfaces);
+		const auto num_sockets = m_socketsData.sockets.size();
+		if (num_sockets == 0) {
+			m_running.store(false, std::memory_order_release);
+			Log(LogLevel::Error, "Failed to open any sockets for the service browser.");
+			throw std::runtime_error("Failed to open any sockets for the service browser.");
+		}
+		Log(LogLevel::Info, fmt::format("Opened {} socket{} for the service browser.", num_sockets, num_sockets > 1 ? "s" : ""));
+
+		m_firstQuestions = BrowseQuestions(m_options, m_options.unicast_response);
+		m_questions = BrowseQuestions(m_options, false);
+		m_types.clear();
+		m_newTypes.clear();
+		m_refresh.clear();
+		m_refreshDue = {};
+		m_refreshHosts.clear();
+		m_browseThread = std::thread([this]() {
+			BrowseLoop();
+		});
+	}
+
+	void Stop()
+	{
+		const bool wasRunning = m_running.exchange(false, std::memory_order_acq_rel);
+		if (m_browseThread.joinable()) {
+			m_browseThread.join();
+		}
+		if (!wasRunning) {
+			return;
+		}
+		for (const auto& socket : m_socketsData.sockets) {
+			mdns_socket_close(socket);
+		}
+		m_socketsData.sockets.clear();
+		Log(LogLevel::Info, "Service browser stopped.");
+	}
+
+	[[nodiscard]] bool Started() const
+	{
+		return m_running.load(std::memory_order_acquire);
+	}
+
+	[[nodiscard]] InstanceTable& Instances()
+	{
+		return *m_instances;
+	}
+
+private:
+	// Fresh PTR records from the record cache that answer <questions>, so responders do not send
+	// them again (RFC 6762 7.1). Only the ones the browser has seen itself: types it enumerated
+	// and instances in its table, a record it never got must not be suppressed
+	std::vector<Record> KnownAnswers(const std::vector<Question>& questions) const
+	{
+		std::vector<Record> known;
+		for (const auto& question : questions) {
+			const DomainName name(question.name);
+			const bool enumeration = (name == kDnsSdServices);
+			for (auto& record : RecordCache::GetInstance().KnownAnswers(name, RecordType::PTR)) {
+				const auto& target = std::get<DomainNamePointerRecord>(record).name_string;
+				const bool seen = enumeration ? std::find(m_types.begin(), m_types.end(), target) != m_types.end()
+				                              : m_instances->Find(target).has_value();
+				if (seen) {
+					known.push_back(std::move(record));
 				}
 			}
 		}
-		Log(LogLevel::Debug, fmt::format("Got {} records", num_records));
-	} while (numberOfReadyDescriptors > 0);
+		return known;
+	}
+
+	// Queries go out on every interface. They come from the mDNS port, so answers to QU questions
+	// arrive on these sockets as well as the multicast ones
+	void Send(uint8_t* buffer, const std::vector<Question>& questions, const std::vector<Record>& known = {})
+	{
+		std::vector<mdns_record_t> answers;
+		for (const auto& record : known) {
+			const auto converted = Convert(record);
+			answers.insert(answers.end(), converted.begin(), converted.end());
+		}
+		const size_t capacity = PacketSizeForMtu(m_socketsData.mtu);
+		const auto send = [&](int socket) {
+			if (answers.empty()) {
+				return SendQuestions(socket, nullptr, 0, buffer, capacity, 0, questions.data(), questions.size());
+			}
+			return SendQuery(socket, nullptr, 0, buffer, capacity, 0, questions.data(), questions.size(), answers.data(), answers.size());
+		};
+		for (const auto& socket : m_socketsData.sockets) {
+			const int family = SocketFamily(socket);
+			bool sent = false;
+			for (const auto& iface : m_socketsData.interfaces) {
+				if (iface.address.ss_family != family) {
+					continue;
+				}
+				SetMulticastInterface(socket, iface);
+				if (send(socket)) {
+					Log(LogLevel::Info, fmt::format("Failed to send browse query on {}: {}", iface.name, strerror(errno)));
+				}
+				sent = true;
+			}
+			if (!sent && send(socket)) {
+				Log(LogLevel::Info, fmt::format("Failed to send browse query: {}", strerror(errno)));
+			}
+		}
+	}
+
+	// Whether the browser asks for the instances of <type>
+	bool Browsed(const DomainName& type) const
+	{
+		const bool asked = std::any_of(m_questions.begin(), m_questions.end(), [&type](const Question& question) { return type == question.name; });
+		return asked || (std::find(m_types.begin(), m_types.end(), type) != m_types.end() &&
+		                 (m_options.service_types.Empty() || m_options.service_types.Matches(type)));
+	}
+
+	// One entry per record: PTR records of one type are told apart by their instance, addresses
+	// of one host by the address
+	static std::string RefreshKey(const Record& record)
+	{
+		const RecordHeader& header = GetHeader(record);
+		std::string key = fmt::format("{} {}", RecordTypeOf(record), header.entry_string.view());
+		if (const auto* ptr = std::get_if<DomainNamePointerRecord>(&record)) {
+			key += " " + std::string(ptr->name_string.view());
+		} else if (const auto* a = std::get_if<ARecord>(&record)) {
+			key += " " + a->address_string;
+		} else if (const auto* aaaa = std::get_if<AAAARecord>(&record)) {
+			key += " " + aaaa->address_string;
+		}
+		return key;
+	}
+
+	// Schedules the maintenance queries of a record the browser relies on: PTR records of the
+	// browsed types, SRV/TXT records of instances in the table and the addresses of their hosts.
+	// Runs on the browse thread from DiscoveryCallback, after the record went into the table
+	void Track(const Record& record)
+	{
+		const RecordHeader& header = GetHeader(record);
+		if (header.entry_type == EntryType::QUESTION) {
+			return;
+		}
+		bool wanted = false;
+		if (std::holds_alternative<DomainNamePointerRecord>(record)) {
+			wanted = header.entry_string == kDnsSdServices || Browsed(header.entry_string);
+		} else if (std::holds_alternative<ServiceRecord>(record) || std::holds_alternative<TXTRecord>(record)) {
+			const auto instance = m_instances->Find(header.entry_string);
+			wanted = instance && Browsed(instance->service_type);
+			if (wanted && header.ttl > 0) {
+				if (const auto* srv = std::get_if<ServiceRecord>(&record)) {
+					m_refreshHosts.insert(srv->service_name);
+				}
+			}
+		} else if (std::holds_alternative<ARecord>(record) || std::holds_alternative<AAAARecord>(record)) {
+			wanted = m_refreshHosts.count(header.entry_string) > 0;
+		}
+		if (!wanted) {
+			return;
+		}
+		std::string key = RefreshKey(record);
+		if (header.ttl == 0) {
+			m_refresh.erase(key);
+			return;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		const std::chrono::seconds ttl(header.ttl);
+		m_refresh[key] = Refresh{header.entry_string, RecordTypeOf(record), now, ttl};
+		m_refreshDue.push({RefreshTime(now, ttl, 0), std::move(key), now, 0});
+	}
+
+	std::chrono::steady_clock::time_point RefreshTime(std::chrono::steady_clock::time_point received, std::chrono::seconds ttl, int step)
+	{
+		std::uniform_int_distribution<int> jitter(0, kRefreshJitterPercent * 10);
+		const auto permille = (kRefreshPercent + step * kRefreshStepPercent) * 10 + jitter(m_random);
+		return received + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(ttl) * permille / 1000);
+	}
+
+	// Questions for the records whose maintenance query is due, one per name and type
+	std::vector<DomainName> DueRefreshes(std::chrono::steady_clock::time_point now, std::vector<Question>& questions)
+	{
+		std::vector<DomainName> names;
+		std::vector<uint16_t> types;
+		while (!m_refreshDue.empty() && m_refreshDue.top().when <= now) {
+			RefreshDue due = m_refreshDue.top();
+			m_refreshDue.pop();
+			const auto it = m_refresh.find(due.key);
+			if (it == m_refresh.end() || it->second.received != due.received) {
+				continue;
+			}
+			const Refresh& refresh = it->second;
+			bool asked = false;
+			for (size_t i = 0; i < names.size(); ++i) {
+				asked = asked || (types[i] == refresh.type && names[i] == refresh.name);
+			}
+			if (!asked) {
+				names.push_back(refresh.name);
+				types.push_back(refresh.type);
+			}
+			if (due.step + 1 < kRefreshSteps) {
+				due.when = RefreshTime(refresh.received, refresh.ttl, due.step + 1);
+				++due.step;
+				m_refreshDue.push(std::move(due));
+			} else {
+				// Not refreshed after the last query, it expires from the table on its own
+				m_refresh.erase(it);
+			}
+		}
+		for (size_t i = 0; i < names.size(); ++i) {
+			questions.push_back({names[i], types[i], QuestionClass(false)});
+		}
+		return names;
+	}
+
+	// The browse query is repeated at least once per the shortest TTL of the records it keeps alive
+	std::chrono::steady_clock::duration ShortestTtl() const
+	{
+		std::chrono::steady_clock::duration shortest = kMaxQueryInterval;
+		for (const auto& [key, refresh] : m_refresh) {
+			shortest = std::min<std::chrono::steady_clock::duration>(shortest, refresh.ttl);
+		}
+		return std::max<std::chrono::steady_clock::duration>(shortest, kFirstQueryInterval);
+	}
+
+	std::vector<Question> TypeQuestions(const std::vector<DomainName>& types, bool unicast) const
+	{
+		std::vector<Question> questions;
+		for (const auto& type : types) {
+			if (m_options.service_types.Empty() || m_options.service_types.Matches(type)) {
+				questions.push_back({type, MDNS_RECORDTYPE_PTR, QuestionClass(unicast)});
+			}
+		}
+		return questions;
+	}
 
-	for (int isock = 0; isock < num_sockets; ++isock) {
-		mdns_socket_close(sockets[isock]);
-    }
-	Log(LogLevel::Debug, "Closed sockets.");
+	void BrowseLoop()
+	{
+		// Big enough for any mDNS packet (RFC 6762 17)
+		std::array<uint8_t, kMaxPacketSize> buffer;
+		DiscoveryContext context{m_options, nullptr, std::chrono::steady_clock::now()};
+		context.interfaces = &m_socketsData.interfaces;
+
+		std::chrono::steady_clock::duration interval = kFirstQueryInterval;
+		auto nextQuery = std::chrono::steady_clock::now();
+		bool first = true;
+		auto nextPurge = nextQuery + kPurgeInterval;
+		while (m_running.load(std::memory_order_acquire)) {
+			const auto now = std::chrono::steady_clock::now();
+			if (now >= nextQuery) {
+				auto questions = first ? m_firstQuestions : m_questions;
+				const auto types = TypeQuestions(m_types, false);
+				questions.insert(questions.end(), types.begin(), types.end());
+				// The first query asks for everything, later ones list what is already known
+				Send(buffer.data(), questions, first ? std::vector<Record>() : KnownAnswers(questions));
+				first = false;
+				nextQuery = now + std::min(interval, ShortestTtl());
+				interval = std::min<std::chrono::steady_clock::duration>(interval * 2, kMaxQueryInterval);
+			} else if (!m_newTypes.empty()) {
+				// Browse newly enumerated types right away rather than at the next query
+				const auto types = TypeQuestions(m_newTypes, m_options.unicast_response);
+				if (!types.empty()) {
+					Send(buffer.data(), types);
+				}
+			}
+			m_newTypes.clear();
+			// Names point into refreshNames
+			std::vector<Question> refresh;
+			const auto refreshNames = DueRefreshes(now, refresh);
+			if (!refresh.empty()) {
+				Send(buffer.data(), refresh);
+			}
+			if (now >= nextPurge) {
+				m_instances->PurgeExpired();
+				nextPurge = now + kPurgeInterval;
+			}
 
-    return recordsOut;
-}   
+			int nfds = 0;
+			fd_set readfs;
+			FD_ZERO(&readfs);
+			for (const auto& sock : m_socketsData.sockets) {
+				if (sock >= nfds)
+					nfds = sock + 1;
+				FD_SET(sock, &readfs);
+			}
+			// Short enough to notice Stop() and the next query quickly
+			struct timeval timeout;
+			timeout.tv_sec = 0;
+			timeout.tv_usec = 100000;
+			if (select(nfds, &readfs, nullptr, nullptr, &timeout) < 0) {
+				Log(LogLevel::Error, fmt::format("Service browser select() failed: {}", strerror(errno)));
+				break;
+			}
+			for (const auto& sock : m_socketsData.sockets) {
+				if (FD_ISSET(sock, &readfs)) {
+					mdns_discovery_recv(sock, buffer.data(), buffer.size(), DiscoveryCallback, &context);
+				}
+			}
+		}
+	}
+};
+
+ServiceBrowser::ServiceBrowser(DiscoveryOptions options)
+: m_impl(std::make_unique<BrowserImpl>(std::move(options)))
+{}
+
+ServiceBrowser::~ServiceBrowser() = default;
+
+void ServiceBrowser::Start()
+{
+	m_impl->Start();
+}
+
+void ServiceBrowser::Stop()
+{
+	m_impl->Stop();
+}
+
+bool ServiceBrowser::Started() const
+{
+	return m_impl->Started();
+}
+
+InstanceTable& ServiceBrowser::Instances()
+{
+	return m_impl->Instances();
+}
+
+InstanceTable::SubscriptionId ServiceBrowser::Subscribe(InstanceCallback callback)
+{
+	return m_impl->Instances().Subscribe(std::move(callback));
+}
+
+void ServiceBrowser::Unsubscribe(InstanceTable::SubscriptionId id)
+{
+	m_impl->Instances().Unsubscribe(id);
+}
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,633 @@
+#include "mdns_cpp/service_instance.hpp"
+#include "mdns.h"
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+#include <fmt/ranges.h>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// RFC 6762 10.2: records older than this are flushed when a cache-flush record arrives
+constexpr std::chrono::seconds kCacheFlushGrace{1};
+
+// The service type named by a PTR owner: "_http._tcp.local." itself, or the type of a subtype
+// such as "_printer._sub._http._tcp.local.". nullopt for anything else, e.g. the DNS-SD type
+// enumeration or reverse address mappings
+std::optional<std::string_view> ServiceTypeOf(std::string_view owner)
+{
+    const auto sub = owner.find("._sub.");
+    if (sub != std::string_view::npos) {
+        owner = owner.substr(sub + 6);
+    }
+    const auto dot = owner.find('.');
+    if (owner.empty() || owner.front() != '_' || dot == std::string_view::npos) {
+        return std::nullopt;
+    }
+    const auto protocol = owner.substr(dot + 1, 5);
+    if (!DomainNameEquals(protocol, "_tcp.") && !DomainNameEquals(protocol, "_udp.")) {
+        return std::nullopt;
+    }
+    if (DomainNameEquals(owner.substr(0, dot), "_services")) {
+        return std::nullopt;
+    }
+    return owner;
+}
+
+// "<instance>.<type>" -> "<type>"
+std::string_view ParentOf(std::string_view name)
+{
+    const auto dot = name.find('.');
+    return dot == std::string_view::npos ? std::string_view() : name.substr(dot + 1);
+}
+
+template <typename T>
+void EraseValue(std::vector<T>& values, const T& value)
+{
+    values.erase(std::remove(values.begin(), values.end(), value), values.end());
+}
+
+}
+
+bool ServiceInstance::Resolved() const
+{
+    return !hostname.empty() && port != 0 && (!ipv4_addresses.empty() || !ipv6_addresses.empty());
+}
+
+bool operator==(const ServiceInstance& lhs, const ServiceInstance& rhs)
+{
+    return lhs.name == rhs.name
+        && lhs.service_type == rhs.service_type
+        && lhs.hostname == rhs.hostname
+        && lhs.port == rhs.port
+        && lhs.priority == rhs.priority
+        && lhs.weight == rhs.weight
+        && lhs.txt == rhs.txt
+        && lhs.ipv4_addresses == rhs.ipv4_addresses
+        && lhs.ipv6_addresses == rhs.ipv6_addresses;
+}
+
+bool operator!=(const ServiceInstance& lhs, const ServiceInstance& rhs)
+{
+    return !(lhs == rhs);
+}
+
+std::ostream& operator<<(std::ostream& os, const ServiceInstance& instance)
+{
+    os << fmt::format("{} -> {}:{} {} {}", instance.name.view(), instance.hostname.view(), instance.port,
+                      instance.ipv4_addresses, instance.ipv6_addresses)
+       << " TXT " << instance.txt;
+    return os;
+}
+
+std::string ToString(InstanceEvent::Kind kind)
+{
+    switch (kind) {
+        case InstanceEvent::Kind::Added: return "added";
+        case InstanceEvent::Kind::Updated: return "updated";
+        case InstanceEvent::Kind::Removed: return "removed";
+    }
+    return "";
+}
+
+std::ostream& operator<<(std::ostream& os, const InstanceEvent& event)
+{
+    os << ToString(event.kind);
+    if (event.kind == InstanceEvent::Kind::Updated) {
+        std::vector<std::string_view> changes;
+        if (event.changes & InstanceEvent::kServiceChanged) {
+            changes.push_back("service");
+        }
+        if (event.changes & InstanceEvent::kTxtChanged) {
+            changes.push_back("txt");
+        }
+        if (event.changes & InstanceEvent::kAddressesChanged) {
+            changes.push_back("addresses");
+        }
+        os << " (" << fmt::format("{}", fmt::join(changes, ", ")) << ")";
+    }
+    os << " " << event.instance;
+    return os;
+}
+
+void InstanceTable::Insert(const Record& record)
+{
+    const RecordHeader& header = GetHeader(record);
+    if (header.entry_type == EntryType::QUESTION) {
+        return;
+    }
+    const auto now = Clock::now();
+    const auto expiry = now + std::chrono::seconds(header.ttl);
+    const bool goodbye = header.ttl == 0;
+    const bool cacheFlush = (header.rclass & MDNS_CACHE_FLUSH) != 0;
+    const DomainName& owner = header.entry_string;
+
+    // The instance or host the record belongs to
+    const auto* ptr = std::get_if<DomainNamePointerRecord>(&record);
+    const auto* srv = std::get_if<ServiceRecord>(&record);
+    const auto* txt = std::get_if<TXTRecord>(&record);
+    const auto* a = std::get_if<ARecord>(&record);
+    const auto* aaaa = std::get_if<AAAARecord>(&record);
+    const auto type = ptr ? ServiceTypeOf(owner) : std::nullopt;
+    if ((ptr && !type) || (!ptr && !srv && !txt && !a && !aaaa)) {
+        return;
+    }
+    const DomainName& key = ptr ? ptr->name_string : owner;
+
+    std::vector<InstanceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        PurgeExpiredLocked(now, events);
+
+        const auto tracked = Track(key, a || aaaa);
+        if (ptr) {
+            if (goodbye) {
+                RemovePtr(key);
+            } else {
+                InsertPtr(*type, key, expiry);
+            }
+        } else if (srv) {
+            if (goodbye) {
+                RemoveSrv(key);
+            } else {
+                InsertSrv(key, *srv, expiry);
+            }
+        } else if (txt) {
+            if (goodbye) {
+                RemoveTxt(key);
+            } else {
+                InsertTxt(key, txt->txt, expiry);
+            }
+        } else {
+            const std::string& address = a ? a->address_string : aaaa->address_string;
+            if (goodbye) {
+                RemoveAddress(key, aaaa != nullptr, address);
+            } else {
+                InsertAddress(key, aaaa != nullptr, address, cacheFlush, now, expiry);
+            }
+        }
+        Diff(tracked, events);
+    }
+    Notify(events);
+}
+
+void InstanceTable::InsertPtr(const DomainName& type, const DomainName& instance, Clock::time_point expiry)
+{
+    const auto [it, added] = m_instances.try_emplace(instance);
+    InstanceEntry& entry = it->second;
+    if (added) {
+        entry.instance.name = instance;
+    }
+    if (entry.instance.service_type.empty()) {
+        entry.instance.service_type = type;
+        m_types[type].push_back(instance);
+    }
+    // Only one pending expiry per record: a later one is picked up when the earlier comes due
+    if (entry.ptr_expiry == Clock::time_point() || expiry < entry.ptr_expiry) {
+        Schedule(expiry, instance, MDNS_RECORDTYPE_PTR);
+    }
+    entry.ptr_expiry = expiry;
+}
+
+void InstanceTable::InsertSrv(const DomainName& instance, const ServiceRecord& record, Clock::time_point expiry)
+{
+    const auto [it, added] = m_instances.try_emplace(instance);
+    InstanceEntry& entry = it->second;
+    ServiceInstance& view = entry.instance;
+    if (added) {
+        view.name = instance;
+    }
+    if (view.service_type.empty()) {
+        view.service_type = ParentOf(instance);
+        m_types[view.service_type].push_back(instance);
+    }
+    if (view.hostname != record.service_name) {
+        if (!view.hostname.empty()) {
+            DetachHost(view.hostname, instance);
+        }
+        view.hostname = record.service_name;
+        AttachHost(view.hostname, instance);
+    }
+    view.port = record.port;
+    view.priority = record.priority;
+    view.weight = record.weight;
+    if (entry.srv_expiry == Clock::time_point() || expiry < entry.srv_expiry) {
+        Schedule(expiry, instance, MDNS_RECORDTYPE_SRV);
+    }
+    entry.srv_expiry = expiry;
+}
+
+void InstanceTable::InsertTxt(const DomainName& instance, const TxtData& txt, Clock::time_point expiry)
+{
+    const auto [it, added] = m_instances.try_emplace(instance);
+    InstanceEntry& entry = it->second;
+    if (added) {
+        entry.instance.name = instance;
+    }
+    entry.instance.txt = txt;
+    if (entry.txt_expiry == Clock::time_point() || expiry < entry.txt_expiry) {
+        Schedule(expiry, instance, MDNS_RECORDTYPE_TXT);
+    }
+    entry.txt_expiry = expiry;
+}
+
+void InstanceTable::InsertAddress(const DomainName& host, bool ipv6, const std::string& address, bool cacheFlush,
+                                  Clock::time_point now, Clock::time_point expiry)
+{
+    auto& addresses = ipv6 ? m_hosts[host].ipv6 : m_hosts[host].ipv4;
+    if (cacheFlush) {
+        addresses.erase(std::remove_if(addresses.begin(), addresses.end(), [&](const Address& known) {
+            return known.address != address && now - known.received > kCacheFlushGrace;
+        }), addresses.end());
+    }
+    const auto it = std::find_if(addresses.begin(), addresses.end(), [&](const Address& known) { return known.address == address; });
+    if (it == addresses.end()) {
+        addresses.push_back({address, now, expiry});
+        Schedule(expiry, host, ipv6 ? MDNS_RECORDTYPE_AAAA : MDNS_RECORDTYPE_A, address);
+        return;
+    }
+    if (expiry < it->expiry) {
+        Schedule(expiry, host, ipv6 ? MDNS_RECORDTYPE_AAAA : MDNS_RECORDTYPE_A, address);
+    }
+    it->received = now;
+    it->expiry = expiry;
+}
+
+void InstanceTable::RemovePtr(const DomainName& instance)
+{
+    const auto it = m_instances.find(instance);
+    if (it == m_instances.end()) {
+        return;
+    }
+    it->second.ptr_expiry = Clock::time_point();
+    EraseInstanceIfUnused(instance);
+}
+
+void InstanceTable::RemoveSrv(const DomainName& instance)
+{
+    const auto it = m_instances.find(instance);
+    if (it == m_instances.end()) {
+        return;
+    }
+    ServiceInstance& view = it->second.instance;
+    if (!view.hostname.empty()) {
+        DetachHost(view.hostname, instance);
+    }
+    view.hostname = DomainName();
+    view.port = 0;
+    view.priority = 0;
+    view.weight = 0;
+    it->second.srv_expiry = Clock::time_point();
+    EraseInstanceIfUnused(instance);
+}
+
+void InstanceTable::RemoveTxt(const DomainName& instance)
+{
+    const auto it = m_instances.find(instance);
+    if (it == m_instances.end()) {
+        return;
+    }
+    it->second.instance.txt.Clear();
+    it->second.txt_expiry = Clock::time_point();
+    EraseInstanceIfUnused(instance);
+}
+
+void InstanceTable::RemoveAddress(const DomainName& host, bool ipv6, const std::string& address)
+{
+    const auto it = m_hosts.find(host);
+    if (it == m_hosts.end()) {
+        return;
+    }
+    auto& addresses = ipv6 ? it->second.ipv6 : it->second.ipv4;
+    addresses.erase(std::remove_if(addresses.begin(), addresses.end(), [&](const Address& known) {
+        return known.address == address;
+    }), addresses.end());
+    EraseHostIfUnused(host);
+}
+
+void InstanceTable::AttachHost(const DomainName& host, const DomainName& instance)
+{
+    m_hosts[host].instances.push_back(instance);
+}
+
+void InstanceTable::DetachHost(const DomainName& host, const DomainName& instance)
+{
+    const auto it = m_hosts.find(host);
+    if (it == m_hosts.end()) {
+        return;
+    }
+    EraseValue(it->second.instances, instance);
+    EraseHostIfUnused(host);
+}
+
+void InstanceTable::EraseInstanceIfUnused(const DomainName& instance)
+{
+    const auto it = m_instances.find(instance);
+    const InstanceEntry& entry = it->second;
+    if (entry.ptr_expiry != Clock::time_point() || entry.srv_expiry != Clock::time_point() ||
+        entry.txt_expiry != Clock::time_point()) {
+        return;
+    }
+    const DomainName& type = entry.instance.service_type;
+    if (!type.empty()) {
+        const auto instances = m_types.find(type);
+        if (instances != m_types.end()) {
+            EraseValue(instances->second, instance);
+            if (instances->second.empty()) {
+                m_types.erase(instances);
+            }
+        }
+    }
+    m_instances.erase(it);
+}
+
+void InstanceTable::EraseHostIfUnused(const DomainName& host)
+{
+    const auto it = m_hosts.find(host);
+    if (it != m_hosts.end() && it->second.ipv4.empty() && it->second.ipv6.empty() && it->second.instances.empty()) {
+        m_hosts.erase(it);
+    }
+}
+
+void InstanceTable::Schedule(Clock::time_point when, const DomainName& name, std::uint16_t type, const std::string& address)
+{
+    m_expiries.push({when, name, type, address});
+}
+
+void InstanceTable::PurgeExpired()
+{
+    std::vector<InstanceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        PurgeExpiredLocked(Clock::now(), events);
+    }
+    Notify(events);
+}
+
+void InstanceTable::PurgeExpiredLocked(Clock::time_point now, std::vector<InstanceEvent>& events)
+{
+    while (!m_expiries.empty() && m_expiries.top().when <= now) {
+        const Expiry due = m_expiries.top();
+        m_expiries.pop();
+
+        if (due.type == MDNS_RECORDTYPE_A || due.type == MDNS_RECORDTYPE_AAAA) {
+            const bool ipv6 = due.type == MDNS_RECORDTYPE_AAAA;
+            const auto host = m_hosts.find(due.name);
+            if (host == m_hosts.end()) {
+                continue;
+            }
+            const auto& addresses = ipv6 ? host->second.ipv6 : host->second.ipv4;
+            const auto address = std::find_if(addresses.begin(), addresses.end(), [&](const Address& known) { return known.address == due.address; });
+            if (address == addresses.end()) {
+                continue;
+            }
+            if (address->expiry > now) {
+                Schedule(address->expiry, due.name, due.type, due.address);
+            } else {
+                const auto tracked = Track(due.name, true);
+                RemoveAddress(due.name, ipv6, due.address);
+                Diff(tracked, events);
+            }
+            continue;
+        }
+        const auto it = m_instances.find(due.name);
+        if (it == m_instances.end()) {
+            continue;
+        }
+        InstanceEntry& entry = it->second;
+        Clock::time_point& expiry = due.type == MDNS_RECORDTYPE_PTR ? entry.ptr_expiry
+                                  : due.type == MDNS_RECORDTYPE_SRV ? entry.srv_expiry
+                                                                    : entry.txt_expiry;
+        if (expiry == Clock::time_point()) {
+            continue;
+        }
+        if (expiry > now) {
+            // Refreshed since this was scheduled
+            Schedule(expiry, due.name, due.type);
+            continue;
+        }
+        const auto tracked = Track(due.name, false);
+        switch (due.type) {
+            case MDNS_RECORDTYPE_PTR: RemovePtr(due.name); break;
+            case MDNS_RECORDTYPE_SRV: RemoveSrv(due.name); break;
+            default: RemoveTxt(due.name); break;
+        }
+        Diff(tracked, events);
+    }
+}
+
+ServiceInstance InstanceTable::Join(const InstanceEntry& entry, Clock::time_point now) const
+{
+    ServiceInstance instance = entry.instance;
+    if (entry.srv_expiry <= now) {
+        instance.hostname = DomainName();
+        instance.port = 0;
+        instance.priority = 0;
+        instance.weight = 0;
+    }
+    if (entry.txt_expiry <= now) {
+        instance.txt.Clear();
+    }
+    if (instance.hostname.empty()) {
+        return instance;
+    }
+    const auto host = m_hosts.find(instance.hostname);
+    if (host == m_hosts.end()) {
+        return instance;
+    }
+    for (const auto& address : host->second.ipv4) {
+        if (address.expiry > now) {
+            instance.ipv4_addresses.push_back(address.address);
+        }
+    }
+    for (const auto& address : host->second.ipv6) {
+        if (address.expiry > now) {
+            instance.ipv6_addresses.push_back(address.address);
+        }
+    }
+    return instance;
+}
+
+std::optional<ServiceInstance> InstanceTable::Find(const DomainName& name) const
+{
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_instances.find(name);
+    if (it == m_instances.end() || (it->second.ptr_expiry <= now && it->second.srv_expiry <= now)) {
+        return std::nullopt;
+    }
+    return Join(it->second, now);
+}
+
+std::vector<ServiceInstance> InstanceTable::Instances() const
+{
+    std::vector<ServiceInstance> out;
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.reserve(m_instances.size());
+    for (const auto& [name, entry] : m_instances) {
+        if (entry.ptr_expiry > now || entry.srv_expiry > now) {
+            out.push_back(Join(entry, now));
+        }
+    }
+    return out;
+}
+
+std::vector<ServiceInstance> InstanceTable::Instances(const DomainName& service_type) const
+{
+    std::vector<ServiceInstance> out;
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto names = m_types.find(service_type);
+    if (names == m_types.end()) {
+        return out;
+    }
+    for (const auto& name : names->second) {
+        const InstanceEntry& entry = m_instances.at(name);
+        if (entry.ptr_expiry > now || entry.srv_expiry > now) {
+            out.push_back(Join(entry, now));
+        }
+    }
+    return out;
+}
+
+void InstanceTable::Clear()
+{
+    std::vector<InstanceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_subscribers.empty()) {
+            for (const auto& item : m_instances) {
+                if (auto current = Current(item.first)) {
+                    InstanceEvent event;
+                    event.kind = InstanceEvent::Kind::Removed;
+                    event.instance = std::move(*current);
+                    events.push_back(std::move(event));
+                }
+            }
+        }
+        m_instances.clear();
+        m_hosts.clear();
+        m_types.clear();
+        m_expiries = decltype(m_expiries)();
+    }
+    Notify(events);
+}
+
+std::size_t InstanceTable::Size() const
+{
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<std::size_t>(std::count_if(m_instances.begin(), m_instances.end(), [now](const auto& item) {
+        return item.second.ptr_expiry > now || item.second.srv_expiry > now;
+    }));
+}
+
+InstanceTable::SubscriptionId InstanceTable::Subscribe(InstanceCallback callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const SubscriptionId id = m_nextSubscription++;
+    m_subscribers.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void InstanceTable::Unsubscribe(SubscriptionId id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(), [id](const auto& subscriber) {
+        return subscriber.first == id;
+    }), m_subscribers.end());
+}
+
+std::optional<ServiceInstance> InstanceTable::Current(const DomainName& name) const
+{
+    const auto it = m_instances.find(name);
+    if (it == m_instances.end() ||
+        (it->second.ptr_expiry == Clock::time_point() && it->second.srv_expiry == Clock::time_point())) {
+        return std::nullopt;
+    }
+    // As stored, records past their expiry but not purged yet still count
+    return Join(it->second, Clock::time_point::min());
+}
+
+std::vector<InstanceTable::Tracked> InstanceTable::Track(const DomainName& name, bool host) const
+{
+    std::vector<Tracked> tracked;
+    if (m_subscribers.empty()) {
+        return tracked;
+    }
+    if (!host) {
+        tracked.push_back({name, Current(name)});
+        return tracked;
+    }
+    const auto it = m_hosts.find(name);
+    if (it != m_hosts.end()) {
+        for (const auto& instance : it->second.instances) {
+            tracked.push_back({instance, Current(instance)});
+        }
+    }
+    return tracked;
+}
+
+void InstanceTable::Diff(const std::vector<Tracked>& tracked, std::vector<InstanceEvent>& events) const
+{
+    for (const auto& item : tracked) {
+        auto after = Current(item.name);
+        InstanceEvent event;
+        if (!item.before && !after) {
+            continue;
+        } else if (!item.before) {
+            event.kind = InstanceEvent::Kind::Added;
+            event.instance = std::move(*after);
+        } else if (!after) {
+            event.kind = InstanceEvent::Kind::Removed;
+            event.instance = *item.before;
+        } else {
+            const ServiceInstance& before = *item.before;
+            if (before.hostname != after->hostname || before.port != after->port ||
+                before.priority != after->priority || before.weight != after->weight) {
+                event.changes |= InstanceEvent::kServiceChanged;
+            }
+            if (!(before.txt == after->txt)) {
+                event.changes |= InstanceEvent::kTxtChanged;
+            }
+            if (before.ipv4_addresses != after->ipv4_addresses || before.ipv6_addresses != after->ipv6_addresses) {
+                event.changes |= InstanceEvent::kAddressesChanged;
+            }
+            if (event.changes == 0) {
+                continue;
+            }
+            event.kind = InstanceEvent::Kind::Updated;
+            event.instance = std::move(*after);
+        }
+        events.push_back(std::move(event));
+    }
+}
+
+void InstanceTable::Notify(const std::vector<InstanceEvent>& events) const
+{
+    if (events.empty()) {
+        return;
+    }
+    std::vector<InstanceCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& subscriber : m_subscribers) {
+            callbacks.push_back(subscriber.second);
+        }
+    }
+    for (const auto& event : events) {
+        for (const auto& callback : callbacks) {
+            callback(event);
+        }
+    }
+}
+
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "mdns_cpp/service.hpp"
+#include "mdns_utils.hpp"
+#include "types_utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace mdns_cpp
+{
+
+// Everything the responder answers with. Immutable once built: when settings change a new
+// snapshot is built and the listen thread swaps it in, so a query is never answered from a
+// half-updated state
+struct ServiceSnapshot
+{
+	std::string service;
+	std::string hostname;
+	std::string service_instance;
+	std::string hostname_qualified;
+	int port;
+
+	DomainNamePointerRecord record_ptr;
+	ServiceRecord record_service;
+	ARecord record_a;
+	AAAARecord record_aaaa;
+	TXTRecord record_txt;
+	std::vector<Record> extra_records;
+	// Interfaces in use, after ServiceSettings::interfaces
+	std::vector<InterfaceAddress> interfaces;
+	RecordCallback on_record;
+	std::shared_ptr<RecordQueue> record_queue;
+	std::shared_ptr<InstanceTable> instances;
+
+	// Points into the members above, hence no copies
+	service_t mdns;
+
+	// The service as answered on one interface, with only that interface's addresses
+	struct InterfaceView
+	{
+		std::uint32_t index{0};
+		const InterfaceAddress* ipv4{nullptr};
+		const InterfaceAddress* ipv6{nullptr};
+		service_t mdns;
+	};
+	// Only built when the sockets report the arrival interface of queries
+	std::vector<InterfaceView> interface_views;
+
+	const InterfaceView* FindInterface(std::uint32_t index) const
+	{
+		for (const auto& view : interface_views) {
+			if (view.index == index) {
+				return &view;
+			}
+		}
+		return nullptr;
+	}
+
+	ServiceSnapshot() = default;
+	ServiceSnapshot(const ServiceSnapshot&) = delete;
+	ServiceSnapshot& operator=(const ServiceSnapshot&) = delete;
+
+	// Every record we announce, used to work out what changed between two snapshots
+	std::vector<Record> AnnouncedRecords() const
+	{
+		std::vector<Record> records;
+		records.reserve(5 + extra_records.size());
+		records.emplace_back(record_ptr);
+		records.emplace_back(record_service);
+		if (mdns.address_ipv4.sin_family == AF_INET) {
+			records.emplace_back(record_a);
+		}
+		if (mdns.address_ipv6.sin6_family == AF_INET6) {
+			records.emplace_back(record_aaaa);
+		}
+		records.emplace_back(record_txt);
+		records.insert(records.end(), extra_records.begin(), extra_records.end());
+		return records;
+	}
+};
+
+// The snapshot of <settings> answered on <sockets_data>. Also used by SimulatedNetwork responders
+inline std::shared_ptr<const ServiceSnapshot> BuildSnapshot(const ServiceSettings& settings, const OpenSocketsData& sockets_data)
+{
+	auto snapshot = std::make_shared<ServiceSnapshot>();
+
+	snapshot->port = settings.port;
+	snapshot->hostname = settings.hostname;
+	snapshot->service = settings.service_name;
+	if (snapshot->service.back() != '.') {
+		snapshot->service += '.';
+	}
+
+	// Build the service instance "<hostname>.<_service-name>._tcp.local." string
+	snapshot->service_instance = fmt::format("{}.{}", snapshot->hostname, snapshot->service);
+	// Build the "<hostname>.local." string
+	snapshot->hostname_qualified = fmt::format("{}.local.", snapshot->hostname);
+
+	// PTR record
+	snapshot->record_ptr.header.entry_string = snapshot->service;
+	snapshot->record_ptr.name_string = snapshot->service_instance;
+
+	// SRV record
+	snapshot->record_service.header.entry_string = snapshot->service_instance;
+	snapshot->record_service.service_name = snapshot->hostname_qualified;
+	snapshot->record_service.port = snapshot->port;
+	snapshot->record_service.weight = 0;
+	snapshot->record_service.priority = 0;
+
+	// A/AAAA record
+	snapshot->record_a.header.entry_string = snapshot->hostname_qualified;
+	snapshot->record_a.address_string = IPV4AddressToString(&sockets_data.service_address_ipv4, sizeof(struct sockaddr_in));
+
+	snapshot->record_aaaa.header.entry_string = snapshot->hostname_qualified;
+	snapshot->record_aaaa.address_string = IPV6AddressToString(&sockets_data.service_address_ipv6, sizeof(struct sockaddr_in6));
+
+	// TXT record
+	snapshot->record_txt.header.entry_string = snapshot->service_instance;
+	snapshot->record_txt.txt = settings.txt;
+
+	// Addresses that do not parse, e.g. from AddRecord(), are left out rather than sent as 0.0.0.0
+	for (const auto& record : settings.extra_records) {
+		const auto converted = Convert(record);
+		const bool invalid = std::any_of(converted.begin(), converted.end(), [](const mdns_record_t& rec) {
+			return (rec.type == MDNS_RECORDTYPE_A && rec.data.a.addr.sin_family != AF_INET) ||
+			       (rec.type == MDNS_RECORDTYPE_AAAA && rec.data.aaaa.addr.sin6_family != AF_INET6);
+		});
+		if (invalid) {
+			Log(LogLevel::Error, fmt::format("Invalid address in extra record for {}, not announced or answered", GetHeader(record).entry_string.view()));
+			continue;
+		}
+		snapshot->extra_records.push_back(record);
+	}
+
+	// create data struct for calls to the mdns lib
+	service_t& mdns = snapshot->mdns;
+	mdns.service = Convert(snapshot->service);
+	mdns.hostname = Convert(snapshot->hostname);
+	mdns.service_instance = Convert(snapshot->service_instance);
+	mdns.hostname_qualified = Convert(snapshot->hostname_qualified);
+	mdns.address_ipv4 = sockets_data.service_address_ipv4;
+	mdns.address_ipv6 = sockets_data.service_address_ipv6;
+	mdns.port = snapshot->port;
+	mdns.passive_cache = settings.passive_cache || !settings.cache_snapshot_path.empty();
+	snapshot->interfaces = sockets_data.interfaces;
+	if (sockets_data.filtered) {
+		mdns.interfaces = &snapshot->interfaces;
+	}
+	snapshot->on_record = settings.on_record;
+	snapshot->record_queue = settings.record_queue;
+	if (snapshot->on_record) {
+		mdns.on_record = &snapshot->on_record;
+	}
+	mdns.record_queue = snapshot->record_queue.get();
+	snapshot->instances = settings.instances;
+	mdns.instances = snapshot->instances.get();
+	mdns.max_packet_size = settings.max_packet_size ? std::min(settings.max_packet_size, kMaxPacketSize) : PacketSizeForMtu(sockets_data.mtu);
+
+	mdns.record_ptr = Convert(snapshot->record_ptr);
+	mdns.record_srv = Convert(snapshot->record_service);
+	mdns.record_a = Convert(snapshot->record_a);
+	mdns.record_a.data.a.addr = sockets_data.service_address_ipv4;
+	mdns.record_aaaa = Convert(snapshot->record_aaaa);
+	mdns.record_aaaa.data.aaaa.addr = sockets_data.service_address_ipv6;
+
+	mdns.records_txt = Convert(snapshot->record_txt);
+
+	for (const auto& record : snapshot->extra_records) {
+		const auto converted = Convert(record);
+		mdns.records_extra.insert(mdns.records_extra.end(), converted.begin(), converted.end());
+	}
+
+	if (sockets_data.packet_info) {
+		for (const auto& iface : snapshot->interfaces) {
+			auto view = std::find_if(snapshot->interface_views.begin(), snapshot->interface_views.end(), [&iface](const auto& existing) {
+				return existing.index == iface.index;
+			});
+			if (view == snapshot->interface_views.end()) {
+				ServiceSnapshot::InterfaceView added;
+				added.index = iface.index;
+				added.mdns = mdns;
+				added.mdns.address_ipv4.sin_family = 0;
+				added.mdns.address_ipv6.sin6_family = 0;
+				view = snapshot->interface_views.insert(snapshot->interface_views.end(), std::move(added));
+			}
+			// The first address of each family on the interface is the one we advertise there
+			if (iface.address.ss_family == AF_INET && !view->ipv4) {
+				view->ipv4 = &iface;
+				std::memcpy(&view->mdns.address_ipv4, &iface.address, sizeof(struct sockaddr_in));
+				view->mdns.record_a.data.a.addr = view->mdns.address_ipv4;
+			} else if (iface.address.ss_family == AF_INET6 && !view->ipv6) {
+				view->ipv6 = &iface;
+				std::memcpy(&view->mdns.address_ipv6, &iface.address, sizeof(struct sockaddr_in6));
+				view->mdns.record_aaaa.data.aaaa.addr = view->mdns.address_ipv6;
+			}
+		}
+	}
+
+	return snapshot;
+}
+
+}
@@ -0,0 +1,458 @@
+#include "mdns_cpp/simulated_network.hpp"
+#include "mdns.h"
+#include "answer_cache.hpp"
+#include "mdns_utils.hpp"
+#include "packet_reader.hpp"
+#include "service_snapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+namespace mdns_cpp
+{
+
+namespace
+{
+
+// Hosts are numbered from 10.0.0.1 on
+constexpr std::uint32_t kFirstAddress = 0x0A000001;
+constexpr std::uint16_t kFirstEphemeralPort = 49152;
+
+struct Packet
+{
+    // Shared by every receiver of a multicast
+    std::shared_ptr<const std::vector<std::uint8_t>> data;
+    struct sockaddr_in from;
+    // Sent to the receiver's address rather than multicast
+    bool direct{false};
+};
+
+struct sockaddr_in MakeAddress(std::uint32_t address, std::uint16_t port)
+{
+    struct sockaddr_in out;
+    std::memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_addr.s_addr = htonl(address);
+    out.sin_port = htons(port);
+    return out;
+}
+
+std::uint64_t EndpointKey(std::uint32_t address, std::uint16_t port)
+{
+    return (static_cast<std::uint64_t>(address) << 16) | port;
+}
+
+std::string AddressToString(std::uint32_t address)
+{
+    return fmt::format("{}.{}.{}.{}", address >> 24, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF);
+}
+
+}
+
+class SimulatedNetwork::Impl : public std::enable_shared_from_this<Impl>
+{
+public:
+    using Clock = Transport::Clock;
+
+    // The Transport of one host
+    class HostTransport : public Transport
+    {
+    public:
+        HostTransport(std::shared_ptr<Impl> network, std::size_t host)
+        : m_network(std::move(network))
+        , m_host(host)
+        {}
+
+        ~HostTransport() override
+        {
+            for (const auto endpoint : m_endpoints) {
+                m_network->Close(endpoint);
+            }
+        }
+
+        std::vector<int> Open(bool mdns_port) override
+        {
+            const int endpoint = m_network->Open(m_host, mdns_port);
+            m_endpoints.push_back(endpoint);
+            return {endpoint};
+        }
+
+        void Close(int endpoint) override
+        {
+            m_endpoints.erase(std::remove(m_endpoints.begin(), m_endpoints.end(), endpoint), m_endpoints.end());
+            m_network->Close(endpoint);
+        }
+
+        int Send(int endpoint, const void* data, std::size_t size, const struct sockaddr* address, std::size_t address_size) override
+        {
+            return m_network->Send(endpoint, data, size, address, address_size);
+        }
+
+        std::vector<int> Wait(const std::vector<int>& endpoints, std::chrono::microseconds timeout) override
+        {
+            return m_network->Wait(endpoints, timeout);
+        }
+
+        std::size_t Receive(int endpoint, void* buffer, std::size_t capacity, struct sockaddr_storage& from, std::size_t& from_size) override
+        {
+            return m_network->Receive(endpoint, buffer, capacity, from, from_size);
+        }
+
+        Clock::time_point Now() const override
+        {
+            return m_network->Now();
+        }
+
+        std::size_t MaxPacketSize() const override
+        {
+            return m_network->MaxPacketSize();
+        }
+
+    private:
+        std::shared_ptr<Impl> m_network;
+        std::size_t m_host;
+        std::vector<int> m_endpoints;
+    };
+
+    explicit Impl(SimulatedNetworkSettings settings)
+    : m_settings(settings)
+    , m_random(settings.seed)
+    {}
+
+    std::shared_ptr<Transport> AddHost()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::make_shared<HostTransport>(shared_from_this(), AddHostLocked());
+    }
+
+    std::string AddResponder(const ServiceSettings& settings)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const std::size_t host = AddHostLocked();
+        Host& responder = m_hosts[host];
+        // What OpenServiceSockets() would find on a host with a single IPv4 interface
+        OpenSocketsData sockets;
+        sockets.service_address_ipv4 = MakeAddress(responder.address, MDNS_PORT);
+        std::memset(&sockets.service_address_ipv6, 0, sizeof(sockets.service_address_ipv6));
+        sockets.mtu = m_settings.mtu;
+        // The records of simulated hosts must not end up in the process-wide RecordCache
+        ServiceSettings simulated = settings;
+        simulated.passive_cache = false;
+        simulated.cache_snapshot_path.clear();
+        responder.service = BuildSnapshot(simulated, sockets);
+        if (settings.answer_provider) {
+            responder.answers = std::make_unique<AnswerCache>(settings.answer_provider, settings.negative_answer_ttl, settings.answer_cache_size);
+        }
+        OpenLocked(host, true);
+        return AddressToString(responder.address);
+    }
+
+    int Open(std::size_t host, bool mdnsPort)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return OpenLocked(host, mdnsPort);
+    }
+
+    void Close(int endpoint)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_endpoints.find(endpoint);
+        if (it == m_endpoints.end()) {
+            return;
+        }
+        const auto bound = m_bound.find(EndpointKey(m_hosts[it->second.host].address, it->second.port));
+        if (bound != m_bound.end() && bound->second == endpoint) {
+            m_bound.erase(bound);
+        }
+        m_multicast.erase(std::remove(m_multicast.begin(), m_multicast.end(), endpoint), m_multicast.end());
+        m_endpoints.erase(it);
+    }
+
+    int Send(int endpoint, const void* data, std::size_t size, const struct sockaddr* address, std::size_t address_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return SendLocked(endpoint, data, size, address, address_size);
+    }
+
+    std::vector<int> Wait(const std::vector<int>& endpoints, std::chrono::microseconds timeout)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto deadline = m_now + timeout;
+        while (true) {
+            std::vector<int> ready;
+            for (const auto endpoint : endpoints) {
+                const auto it = m_endpoints.find(endpoint);
+                if (it != m_endpoints.end() && !it->second.inbox.empty()) {
+                    ready.push_back(endpoint);
+                }
+            }
+            if (!ready.empty()) {
+                return ready;
+            }
+            if (!DeliverNext(deadline)) {
+                m_now = std::max(m_now, deadline);
+                return ready;
+            }
+        }
+    }
+
+    std::size_t Receive(int endpoint, void* buffer, std::size_t capacity, struct sockaddr_storage& from, std::size_t& from_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_endpoints.find(endpoint);
+        if (it == m_endpoints.end() || it->second.inbox.empty()) {
+            return 0;
+        }
+        const Packet packet = std::move(it->second.inbox.front());
+        it->second.inbox.pop_front();
+        const std::size_t size = std::min(capacity, packet.data->size());
+        std::memcpy(buffer, packet.data->data(), size);
+        std::memset(&from, 0, sizeof(from));
+        std::memcpy(&from, &packet.from, sizeof(packet.from));
+        from_size = sizeof(packet.from);
+        return size;
+    }
+
+    Clock::time_point Now() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_now;
+    }
+
+    void Advance(std::chrono::microseconds duration)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto until = m_now + duration;
+        while (DeliverNext(until)) {
+        }
+        m_now = until;
+    }
+
+    std::size_t MaxPacketSize() const
+    {
+        return PacketSizeForMtu(m_settings.mtu);
+    }
+
+    Statistics Stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    // The Transport ServiceCallback sends through when a responder answers. That happens within
+    // DeliverNext(), so m_mutex is already held
+    class ResponderTransport : public Transport
+    {
+    public:
+        explicit ResponderTransport(Impl& network)
+        : m_network(network)
+        {}
+
+        std::vector<int> Open(bool) override { return {}; }
+        void Close(int) override {}
+
+        int Send(int endpoint, const void* data, std::size_t size, const struct sockaddr* address, std::size_t address_size) override
+        {
+            return m_network.SendLocked(endpoint, data, size, address, address_size);
+        }
+
+        std::vector<int> Wait(const std::vector<int>&, std::chrono::microseconds) override { return {}; }
+        std::size_t Receive(int, void*, std::size_t, struct sockaddr_storage&, std::size_t&) override { return 0; }
+        Clock::time_point Now() const override { return m_network.m_now; }
+        std::size_t MaxPacketSize() const override { return m_network.MaxPacketSize(); }
+
+    private:
+        Impl& m_network;
+    };
+
+    struct Host
+    {
+        std::uint32_t address;
+        std::uint16_t next_port{kFirstEphemeralPort};
+        // Set for responders, answered from by ServiceCallback
+        std::shared_ptr<const ServiceSnapshot> service;
+        std::unique_ptr<AnswerCache> answers;
+    };
+    struct Endpoint
+    {
+        std::size_t host;
+        std::uint16_t port;
+        std::deque<Packet> inbox;
+    };
+    struct Delivery
+    {
+        Clock::time_point when;
+        // Keeps packets due at the same time in the order they were sent
+        std::uint64_t sequence;
+        int endpoint;
+        Packet packet;
+        bool operator>(const Delivery& other) const
+        {
+            return when != other.when ? when > other.when : sequence > other.sequence;
+        }
+    };
+
+    // m_mutex must be held for all of these
+    std::size_t AddHostLocked()
+    {
+        Host host;
+        host.address = kFirstAddress + static_cast<std::uint32_t>(m_hosts.size());
+        m_hosts.push_back(std::move(host));
+        return m_hosts.size() - 1;
+    }
+
+    int OpenLocked(std::size_t host, bool mdnsPort)
+    {
+        const int id = m_nextEndpoint++;
+        Endpoint endpoint;
+        endpoint.host = host;
+        endpoint.port = mdnsPort ? MDNS_PORT : m_hosts[host].next_port++;
+        m_bound[EndpointKey(m_hosts[host].address, endpoint.port)] = id;
+        if (mdnsPort) {
+            m_multicast.push_back(id);
+        }
+        m_endpoints.emplace(id, std::move(endpoint));
+        return id;
+    }
+
+    int SendLocked(int endpoint, const void* data, std::size_t size, const struct sockaddr* to, std::size_t to_size)
+    {
+        if (to && (to->sa_family != AF_INET || to_size < sizeof(struct sockaddr_in))) {
+            return -1;
+        }
+        const auto it = m_endpoints.find(endpoint);
+        if (it == m_endpoints.end()) {
+            return -1;
+        }
+        ++m_stats.sent;
+        auto bytes = std::make_shared<const std::vector<std::uint8_t>>(static_cast<const std::uint8_t*>(data),
+                                                                       static_cast<const std::uint8_t*>(data) + size);
+        const auto* address = reinterpret_cast<const struct sockaddr_in*>(to);
+        Packet packet{std::move(bytes), MakeAddress(m_hosts[it->second.host].address, it->second.port), address != nullptr};
+        if (!address) {
+            for (const auto receiver : m_multicast) {
+                if (receiver != endpoint) {
+                    Schedule(receiver, packet);
+                }
+            }
+            return 0;
+        }
+        const auto bound = m_bound.find(EndpointKey(ntohl(address->sin_addr.s_addr), ntohs(address->sin_port)));
+        if (bound != m_bound.end()) {
+            Schedule(bound->second, std::move(packet));
+        }
+        return 0;
+    }
+
+    void Schedule(int endpoint, Packet packet)
+    {
+        if (m_settings.loss > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_settings.loss) {
+            ++m_stats.lost;
+            return;
+        }
+        auto delay = m_settings.delay;
+        if (m_settings.jitter.count() > 0) {
+            delay += std::chrono::microseconds(std::uniform_int_distribution<std::int64_t>(0, m_settings.jitter.count())(m_random));
+        }
+        m_deliveries.push({m_now + delay, m_sequence++, endpoint, std::move(packet)});
+    }
+
+    // Delivers the next packet if it is due by <until>, moving time to it
+    bool DeliverNext(Clock::time_point until)
+    {
+        if (m_deliveries.empty() || m_deliveries.top().when > until) {
+            return false;
+        }
+        Delivery delivery = m_deliveries.top();
+        m_deliveries.pop();
+        m_now = std::max(m_now, delivery.when);
+        const auto it = m_endpoints.find(delivery.endpoint);
+        if (it == m_endpoints.end()) {
+            return true;
+        }
+        ++m_stats.delivered;
+        if (m_hosts[it->second.host].service) {
+            Respond(delivery.endpoint, m_hosts[it->second.host], delivery.packet);
+        } else {
+            it->second.inbox.push_back(std::move(delivery.packet));
+        }
+        return true;
+    }
+
+    // Hands the packet to ServiceCallback like the listen thread of a Service does, the answers
+    // come back through ResponderTransport
+    void Respond(int endpoint, const Host& host, const Packet& packet)
+    {
+        const service_t& mdns = host.service->mdns;
+        const auto& bytes = *packet.data;
+        // Responses only matter to a responder that records them, skip parsing them otherwise
+        const bool response = bytes.size() > 2 && (bytes[2] & 0x80);
+        if (response && !mdns.passive_cache && !mdns.on_record && !mdns.record_queue && !mdns.instances) {
+            return;
+        }
+        ListenContext context;
+        context.service = &mdns;
+        context.direct = packet.direct;
+        context.answers = host.answers.get();
+        ResponderTransport transport(*this);
+        TransportScope scope(&transport);
+        ParsePacket(endpoint, reinterpret_cast<const struct sockaddr*>(&packet.from), sizeof(packet.from), bytes.data(),
+                    bytes.size(), ServiceCallback, &context, false);
+    }
+
+    mutable std::mutex m_mutex;
+    SimulatedNetworkSettings m_settings;
+    std::mt19937_64 m_random;
+    Clock::time_point m_now;
+    std::uint64_t m_sequence{0};
+    std::vector<Host> m_hosts;
+    std::unordered_map<int, Endpoint> m_endpoints;
+    // address:port -> endpoint bound to it
+    std::unordered_map<std::uint64_t, int> m_bound;
+    // Endpoints on the mDNS port, in the order they were opened
+    std::vector<int> m_multicast;
+    int m_nextEndpoint{0};
+    std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> m_deliveries;
+    Statistics m_stats;
+};
+
+SimulatedNetwork::SimulatedNetwork(SimulatedNetworkSettings settings)
+: m_impl(std::make_shared<Impl>(settings))
+{}
+
+SimulatedNetwork::~SimulatedNetwork() = default;
+
+std::shared_ptr<Transport> SimulatedNetwork::AddHost()
+{
+    return m_impl->AddHost();
+}
+
+std::string SimulatedNetwork::AddResponder(const ServiceSettings& settings)
+{
+    return m_impl->AddResponder(settings);
+}
+
+Transport::Clock::time_point SimulatedNetwork::Now() const
+{
+    return m_impl->Now();
+}
+
+void SimulatedNetwork::Advance(std::chrono::microseconds duration)
+{
+    m_impl->Advance(duration);
+}
+
+SimulatedNetwork::Statistics SimulatedNetwork::Stats() const
+{
+    return m_impl->Stats();
+}
+
+}
@@ -1,9 +1,13 @@
 #include "mdns_cpp/types.hpp"
+#include "ascii_case.hpp"
 
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
 
+#include <algorithm>
+#include <cstring>
+
 
 namespace mdns_cpp
 {
@@ -20,6 +24,94 @@ std::string ToString(EntryType entry)
     return "";
 }
 
+namespace
+{
+
+std::string_view TrimRootDot(std::string_view name)
+{
+    if (!name.empty() && name.back() == '.') {
+        name.remove_suffix(1);
+    }
+    return name;
+}
+
+}
+
+void DomainName::Assign(std::string_view name)
+{
+    m_length = static_cast<std::uint8_t>(std::min(name.size(), kMaxLength));
+    std::memcpy(m_data.data(), name.data(), m_length);
+}
+
+DomainName& DomainName::Append(std::string_view suffix)
+{
+    if (m_length > 0 && back() != '.' && m_length < kMaxLength) {
+        m_data[m_length++] = '.';
+    }
+    const auto count = std::min(suffix.size(), kMaxLength - m_length);
+    std::memcpy(m_data.data() + m_length, suffix.data(), count);
+    m_length = static_cast<std::uint8_t>(m_length + count);
+    return *this;
+}
+
+std::size_t DomainName::LabelCount() const
+{
+    const auto name = TrimRootDot(view());
+    if (name.empty()) {
+        return 0;
+    }
+    return static_cast<std::size_t>(std::count(name.begin(), name.end(), '.')) + 1;
+}
+
+std::string_view DomainName::Label(std::size_t index) const
+{
+    auto name = TrimRootDot(view());
+    for (; index > 0; --index) {
+        const auto dot = name.find('.');
+        if (dot == std::string_view::npos) {
+            return {};
+        }
+        name.remove_prefix(dot + 1);
+    }
+    return name.substr(0, name.find('.'));
+}
+
+bool DomainName::EndsWith(std::string_view suffix) const
+{
+    const auto name = TrimRootDot(view());
+    suffix = TrimRootDot(suffix);
+    if (suffix.size() > name.size()) {
+        return false;
+    }
+    const auto start = name.size() - suffix.size();
+    // Must end on a label boundary, "myhost.local." does not end with "host.local."
+    if (start > 0 && !suffix.empty() && name[start - 1] != '.') {
+        return false;
+    }
+    return AsciiEqualsIgnoreCase(name.substr(start), suffix);
+}
+
+std::size_t DomainName::Hash() const
+{
+    return DomainNameHash(view());
+}
+
+bool DomainNameEquals(std::string_view lhs, std::string_view rhs)
+{
+    return AsciiEqualsIgnoreCase(TrimRootDot(lhs), TrimRootDot(rhs));
+}
+
+std::size_t DomainNameHash(std::string_view name)
+{
+    return static_cast<std::size_t>(AsciiHashIgnoreCase(TrimRootDot(name)));
+}
+
+std::ostream& operator<<(std::ostream& os, const DomainName& name)
+{
+    os << name.view();
+    return os;
+}
+
 bool operator==(const RecordHeader& lhs, const RecordHeader& rhs)
 {
     return lhs.ip_address == rhs.ip_address
@@ -33,7 +125,7 @@ bool operator==(const RecordHeader& lhs, const RecordHeader& rhs)
 
 std::ostream& operator<<(std::ostream& os, const RecordHeader& header)
 {
-    os << fmt::format("{} : {} {} record_type {} rclass {:#x} ttl {} record_length {}", header.ip_address, ToString(header.entry_type), header.entry_string, header.record_type, header.rclass, header.ttl, header.record_length);
+    os << fmt::format("{} : {} {} record_type {} rclass {:#x} ttl {} record_length {}", header.ip_address, ToString(header.entry_type), header.entry_string.view(), header.record_type, header.rclass, header.ttl, header.record_length);
     return os;
 }
 
@@ -49,7 +141,7 @@ std::ostream& operator<<(std::ostream& os, const DomainNamePointerRecord& record
     //  printf("%.*s : %s %.*s PTR %.*s rclass 0x%x ttl %u length %d\n",
     //        MDNS_STRING_FORMAT(fromaddrstr), entrytype, MDNS_STRING_FORMAT(entrystr),
     //        MDNS_STRING_FORMAT(namestr), rclass, ttl, (int)record_length);
-    os << fmt::format("{} PTR {}", record.header, record.name_string);
+    os << fmt::format("{} PTR {}", record.header, record.name_string.view());
     return os;
 }
 
@@ -67,7 +159,7 @@ std::ostream& operator<<(std::ostream& os, const ServiceRecord& record)
     // printf("%.*s : %s %.*s SRV %.*s priority %d weight %d port %d\n",
     //        MDNS_STRING_FORMAT(fromaddrstr), entrytype, MDNS_STRING_FORMAT(entrystr),
     //        MDNS_STRING_FORMAT(srv.name), srv.priority, srv.weight, srv.port);
-    os << fmt::format("{} SRV {} priority {} weight {} port {}", record.header, record.service_name, record.priority, record.weight, record.port);
+    os << fmt::format("{} SRV {} priority {} weight {} port {}", record.header, record.service_name.view(), record.priority, record.weight, record.port);
     return os;
 }
 
@@ -99,6 +191,200 @@ std::ostream& operator<<(std::ostream& os, const AAAARecord& record)
     return os;
 }
 
+TxtData::TxtData(std::initializer_list<std::pair<std::string_view, std::string_view>> entries)
+{
+    std::size_t bytes = 0;
+    for (const auto& entry : entries) {
+        bytes += entry.first.size() + entry.second.size() + 2;
+    }
+    Reserve(entries.size(), bytes);
+    for (const auto& entry : entries) {
+        Add(entry.first, entry.second);
+    }
+}
+
+TxtData TxtData::FromWire(const void* data, std::size_t length)
+{
+    TxtData txt;
+    const auto bytes = static_cast<const std::uint8_t*>(data);
+    length = std::min(length, kMaxWireSize);
+    txt.m_wire.reserve(length);
+
+    std::size_t pos = 0;
+    while (pos < length) {
+        const std::size_t string_length = bytes[pos];
+        if (pos + 1 + string_length > length) {
+            break;
+        }
+        // Skip empty strings (an empty TXT record is a single zero byte) and strings starting with '='
+        if (string_length > 0 && bytes[pos + 1] != '=') {
+            const auto offset = txt.m_wire.size();
+            txt.m_wire.append(reinterpret_cast<const char*>(bytes + pos), string_length + 1);
+            txt.IndexString(offset);
+        }
+        pos += string_length + 1;
+    }
+    return txt;
+}
+
+void TxtData::Reserve(std::size_t count, std::size_t bytes)
+{
+    m_index.reserve(count);
+    m_wire.reserve(std::min(bytes, kMaxWireSize));
+}
+
+void TxtData::Add(std::string_view key, std::optional<std::string_view> value)
+{
+    if (key.empty()) {
+        return;
+    }
+    key = key.substr(0, 255);
+    if (value) {
+        value = value->substr(0, std::max<std::ptrdiff_t>(0, 254 - static_cast<std::ptrdiff_t>(key.size())));
+    }
+    const std::size_t string_length = std::min<std::size_t>(key.size() + (value ? value->size() + 1 : 0), 255);
+    if (m_wire.size() + string_length + 1 > kMaxWireSize) {
+        return;
+    }
+
+    const auto offset = m_wire.size();
+    m_wire += static_cast<char>(string_length);
+    m_wire += key;
+    if (value && key.size() < 255) {
+        m_wire += '=';
+        m_wire += *value;
+    }
+    IndexString(offset);
+}
+
+void TxtData::CopyString(const TxtData& other, std::size_t index)
+{
+    const Slot& slot = other.m_index[index];
+    const auto string_length = static_cast<std::uint8_t>(other.m_wire[slot.offset]);
+    const auto offset = m_wire.size();
+    m_wire.append(other.m_wire, slot.offset, string_length + 1u);
+    IndexString(offset);
+}
+
+void TxtData::Set(std::string_view key, std::optional<std::string_view> value)
+{
+    if (!Contains(key)) {
+        Add(key, value);
+        return;
+    }
+    TxtData updated;
+    updated.Reserve(m_index.size(), m_wire.size() + (value ? value->size() : 0));
+    bool replaced = false;
+    for (std::size_t i = 0; i < m_index.size(); ++i) {
+        const auto entry = (*this)[i];
+        if (!replaced && AsciiEqualsIgnoreCase(entry.key, key)) {
+            updated.Add(entry.key, value);
+            replaced = true;
+        } else {
+            updated.CopyString(*this, i);
+        }
+    }
+    *this = std::move(updated);
+}
+
+bool TxtData::Remove(std::string_view key)
+{
+    if (!Contains(key)) {
+        return false;
+    }
+    TxtData updated;
+    updated.Reserve(m_index.size(), m_wire.size());
+    for (std::size_t i = 0; i < m_index.size(); ++i) {
+        if (!AsciiEqualsIgnoreCase((*this)[i].key, key)) {
+            updated.CopyString(*this, i);
+        }
+    }
+    *this = std::move(updated);
+    return true;
+}
+
+void TxtData::Clear()
+{
+    m_wire.clear();
+    m_index.clear();
+}
+
+std::optional<std::string_view> TxtData::Find(std::string_view key) const
+{
+    if (const auto entry = FindEntry(key)) {
+        return entry->value;
+    }
+    return std::nullopt;
+}
+
+std::optional<TxtData::Entry> TxtData::FindEntry(std::string_view key) const
+{
+    for (std::size_t i = 0; i < m_index.size(); ++i) {
+        // Cheap length check first, most keys are rejected without touching m_wire
+        if (m_index[i].key_length == key.size()) {
+            const auto entry = (*this)[i];
+            if (AsciiEqualsIgnoreCase(entry.key, key)) {
+                return entry;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+TxtData::Entry TxtData::operator[](std::size_t index) const
+{
+    const Slot& slot = m_index[index];
+    const std::string_view wire = m_wire;
+    Entry entry;
+    entry.key = wire.substr(slot.offset + 1, slot.key_length);
+    entry.value = wire.substr(slot.offset + 1 + slot.key_length + (slot.has_value ? 1 : 0), slot.value_length);
+    entry.has_value = slot.has_value;
+    return entry;
+}
+
+void TxtData::IndexString(std::size_t offset)
+{
+    const auto string_length = static_cast<std::uint8_t>(m_wire[offset]);
+    const std::string_view str(m_wire.data() + offset + 1, string_length);
+    const auto separator = str.find('=');
+
+    Slot slot;
+    slot.offset = static_cast<std::uint16_t>(offset);
+    if (separator == std::string_view::npos) {
+        slot.key_length = string_length;
+        slot.value_length = 0;
+        slot.has_value = false;
+    } else {
+        slot.key_length = static_cast<std::uint8_t>(separator);
+        slot.value_length = static_cast<std::uint8_t>(string_length - separator - 1);
+        slot.has_value = true;
+    }
+    m_index.push_back(slot);
+}
+
+bool operator==(const TxtData& lhs, const TxtData& rhs)
+{
+    return lhs.Wire() == rhs.Wire();
+}
+
+std::ostream& operator<<(std::ostream& os, const TxtData& txt)
+{
+    os << "[";
+    bool first = true;
+    for (const auto entry : txt) {
+        if (!first) {
+            os << ", ";
+        }
+        os << entry.key;
+        if (entry.has_value) {
+            os << "=" << entry.value;
+        }
+        first = false;
+    }
+    os << "]";
+    return os;
+}
+
 bool operator==(const TXTRecord& lhs, const TXTRecord& rhs)
 {
     return lhs.header == rhs.header
@@ -111,8 +397,142 @@ std::ostream& operator<<(std::ostream& os, const TXTRecord& record)
     //        entrytype, MDNS_STRING_FORMAT(entrystr),
     //        MDNS_STRING_FORMAT(txtbuffer[itxt].key),
     //        MDNS_STRING_FORMAT(txtbuffer[itxt].value));
-    // TODO: improve this
-    os << fmt::format("{} TXT {}", record.header, record.txt);
+    os << record.header << " TXT " << record.txt;
+    return os;
+}
+
+bool operator==(const CNAMERecord& lhs, const CNAMERecord& rhs)
+{
+    return lhs.header == rhs.header
+        && lhs.target == rhs.target;
+}
+
+std::ostream& operator<<(std::ostream& os, const CNAMERecord& record)
+{
+    os << fmt::format("{} CNAME {}", record.header, record.target.view());
+    return os;
+}
+
+bool operator==(const HINFORecord& lhs, const HINFORecord& rhs)
+{
+    return lhs.header == rhs.header
+        && lhs.cpu == rhs.cpu
+        && lhs.os == rhs.os;
+}
+
+std::ostream& operator<<(std::ostream& os, const HINFORecord& record)
+{
+    os << fmt::format("{} HINFO {} {}", record.header, record.cpu, record.os);
+    return os;
+}
+
+TypeBitmap::TypeBitmap(std::initializer_list<std::uint16_t> types)
+{
+    for (const auto type : types) {
+        Add(type);
+    }
+}
+
+TypeBitmap TypeBitmap::FromWire(const void* data, std::size_t length)
+{
+    TypeBitmap bitmap;
+    const auto bytes = static_cast<const std::uint8_t*>(data);
+    std::size_t pos = 0;
+    int last_window = -1;
+    // Windows must be in increasing order and 1-32 bytes long
+    while (pos + 2 <= length) {
+        const std::size_t window = bytes[pos];
+        const std::size_t window_length = bytes[pos + 1];
+        if (static_cast<int>(window) <= last_window || window_length == 0 || window_length > 32 ||
+            pos + 2 + window_length > length) {
+            break;
+        }
+        bitmap.m_wire.append(reinterpret_cast<const char*>(bytes + pos), window_length + 2);
+        last_window = static_cast<int>(window);
+        pos += window_length + 2;
+    }
+    return bitmap;
+}
+
+void TypeBitmap::Add(std::uint16_t type)
+{
+    if (Contains(type)) {
+        return;
+    }
+    const auto window = static_cast<std::uint8_t>(type >> 8);
+    const std::size_t byte = (type & 0xFF) / 8;
+    const auto bit = static_cast<char>(0x80 >> (type % 8));
+
+    std::size_t pos = 0;
+    while (pos < m_wire.size() && static_cast<std::uint8_t>(m_wire[pos]) < window) {
+        pos += static_cast<std::uint8_t>(m_wire[pos + 1]) + 2;
+    }
+    if (pos == m_wire.size() || static_cast<std::uint8_t>(m_wire[pos]) != window) {
+        const char header[2] = {static_cast<char>(window), 0};
+        m_wire.insert(pos, header, 2);
+    }
+    auto window_length = static_cast<std::uint8_t>(m_wire[pos + 1]);
+    if (byte >= window_length) {
+        m_wire.insert(pos + 2 + window_length, byte + 1 - window_length, '\0');
+        window_length = static_cast<std::uint8_t>(byte + 1);
+        m_wire[pos + 1] = static_cast<char>(window_length);
+    }
+    m_wire[pos + 2 + byte] |= bit;
+}
+
+bool TypeBitmap::Contains(std::uint16_t type) const
+{
+    const auto window = static_cast<std::uint8_t>(type >> 8);
+    const std::size_t byte = (type & 0xFF) / 8;
+    std::size_t pos = 0;
+    while (pos < m_wire.size()) {
+        const auto window_length = static_cast<std::uint8_t>(m_wire[pos + 1]);
+        if (static_cast<std::uint8_t>(m_wire[pos]) == window) {
+            return byte < window_length && (m_wire[pos + 2 + byte] & (0x80 >> (type % 8)));
+        }
+        pos += window_length + 2;
+    }
+    return false;
+}
+
+std::vector<std::uint16_t> TypeBitmap::Types() const
+{
+    std::vector<std::uint16_t> types;
+    std::size_t pos = 0;
+    while (pos < m_wire.size()) {
+        const auto window = static_cast<std::uint8_t>(m_wire[pos]);
+        const auto window_length = static_cast<std::uint8_t>(m_wire[pos + 1]);
+        for (std::size_t i = 0; i < window_length * 8u; ++i) {
+            if (m_wire[pos + 2 + i / 8] & (0x80 >> (i % 8))) {
+                types.push_back(static_cast<std::uint16_t>(window * 256 + i));
+            }
+        }
+        pos += window_length + 2;
+    }
+    return types;
+}
+
+bool operator==(const TypeBitmap& lhs, const TypeBitmap& rhs)
+{
+    return lhs.Wire() == rhs.Wire();
+}
+
+std::ostream& operator<<(std::ostream& os, const TypeBitmap& types)
+{
+    os << fmt::format("{}", types.Types());
+    return os;
+}
+
+bool operator==(const NSECRecord& lhs, const NSECRecord& rhs)
+{
+    return lhs.header == rhs.header
+        && lhs.next_domain == rhs.next_domain
+        && lhs.types == rhs.types;
+}
+
+std::ostream& operator<<(std::ostream& os, const NSECRecord& record)
+{
+    os << fmt::format("{} NSEC {} {}", record.header, record.next_domain.view(), record.types);
     return os;
 }
 
@@ -138,4 +558,18 @@ std::ostream& operator<<(std::ostream& os, const Record& record)
     return os;
 }
 
-}
\ No newline at end of file
+const RecordHeader& GetHeader(const Record& record)
+{
+    return std::visit([](const auto& rec) -> const RecordHeader& {
+        return rec.header;
+    }, record);
+}
+
+RecordHeader& GetHeader(Record& record)
+{
+    return std::visit([](auto& rec) -> RecordHeader& {
+        return rec.header;
+    }, record);
+}
+
+}
@@ -3,7 +3,21 @@
 #include "mdns_cpp/types.hpp"
 #include "mdns.h"
 
+#include <charconv>
+#include <cstdint>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <fmt/format.h>
+
+#ifdef _WIN32
+#include <Ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
 
 namespace mdns_cpp
 {
@@ -12,6 +26,99 @@ inline mdns_string_t Convert(std::string_view str) {
     return mdns_string_t{str.data(), str.size()};
 }
 
+inline std::string IPV4AddressToString(const sockaddr_in *addr, size_t addrlen) {
+  char host[NI_MAXHOST] = {0};
+  char service[NI_MAXSERV] = {0};
+  const int ret = getnameinfo((const struct sockaddr *)addr, (socklen_t)addrlen, host, NI_MAXHOST, service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
+  if (ret == 0) {
+    if (addr->sin_port != 0) {
+	  return fmt::format("{}:{}", host, service);
+    } else {
+	  return fmt::format("{}", host);
+    }
+  }
+  return "";
+}
+
+inline std::string IPV6AddressToString(const sockaddr_in6 *addr, size_t addrlen) {
+  char host[NI_MAXHOST] = {0};
+  char service[NI_MAXSERV] = {0};
+  const int ret = getnameinfo((const struct sockaddr *)addr, (socklen_t)addrlen, host, NI_MAXHOST, service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
+  if (ret == 0) {
+    if (addr->sin6_port != 0) {
+	  return fmt::format("[{}]:{}", host, service);
+    } else {
+	  return fmt::format("{}", host);
+    }
+  }
+  return "";
+}
+
+inline std::string IPAddressToString(const sockaddr *addr, size_t addrlen) {
+  if (addr->sa_family == AF_INET6) {
+    return IPV6AddressToString((const struct sockaddr_in6 *)addr, addrlen);
+  }
+  return IPV4AddressToString((const struct sockaddr_in *)addr, addrlen);
+}
+
+// Port suffix of an address string, false unless all of <str> is a number up to 65535
+inline bool ParsePort(std::string_view str, std::uint16_t& port)
+{
+    const char* end = str.data() + str.size();
+    const auto result = std::from_chars(str.data(), end, port);
+    return !str.empty() && result.ec == std::errc() && result.ptr == end;
+}
+
+// Parses "192.168.1.2" or "192.168.1.2:80" as produced by IPV4AddressToString().
+// sin_family is 0 if <str> is not such an address
+inline struct sockaddr_in ParseIPV4Address(std::string_view str)
+{
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    const auto colon = str.find(':');
+    const std::string host(str.substr(0, colon));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        addr.sin_family = 0;
+    }
+    if (colon != std::string_view::npos) {
+        std::uint16_t port = 0;
+        if (!ParsePort(str.substr(colon + 1), port)) {
+            addr.sin_family = 0;
+            return addr;
+        }
+        addr.sin_port = htons(port);
+    }
+    return addr;
+}
+
+// Parses "fe80::1" or "[fe80::1]:80" as produced by IPV6AddressToString().
+// sin6_family is 0 if <str> is not such an address
+inline struct sockaddr_in6 ParseIPV6Address(std::string_view str)
+{
+    struct sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    std::string_view host = str;
+    if (!str.empty() && str.front() == '[') {
+        const auto close = str.find(']');
+        host = str.substr(1, close == std::string_view::npos ? std::string_view::npos : close - 1);
+        if (close != std::string_view::npos && close + 1 < str.size() && str[close + 1] == ':') {
+            std::uint16_t port = 0;
+            if (!ParsePort(str.substr(close + 2), port)) {
+                addr.sin6_family = 0;
+                return addr;
+            }
+            addr.sin6_port = htons(port);
+        }
+    }
+    // Drop any "%scope" suffix, inet_pton does not understand it
+    host = host.substr(0, host.find('%'));
+    const std::string hostString(host);
+    if (inet_pton(AF_INET6, hostString.c_str(), &addr.sin6_addr) != 1) {
+        addr.sin6_family = 0;
+    }
+    return addr;
+}
+
 inline mdns_record_t Convert(const DomainNamePointerRecord& record)
 {
     // // PTR record reverse mapping "<_service-name>._tcp.local." to
@@ -21,7 +128,7 @@ inline mdns_record_t Convert(const DomainNamePointerRecord& record)
     //                                      .data.ptr.name = service.service_instance,
     //                                      .rclass = 0,
     //                                      .ttl = 0};
-    mdns_record_t recordOut;
+    mdns_record_t recordOut{};
     recordOut.name = Convert(record.header.entry_string);
     recordOut.type = MDNS_RECORDTYPE_PTR;
     recordOut.data.ptr.name = Convert(record.name_string);
@@ -43,7 +150,7 @@ inline mdns_record_t Convert(const ServiceRecord& record)
     //                                      .data.srv.weight = 0,
     //                                      .rclass = 0,
     //                                      .ttl = 0};
-    mdns_record_t recordOut;
+    mdns_record_t recordOut{};
     recordOut.name = Convert(record.header.entry_string);
     recordOut.type = MDNS_RECORDTYPE_SRV;
     recordOut.data.srv.name = Convert(record.service_name);
@@ -65,10 +172,10 @@ inline mdns_record_t Convert(const ARecord& record)
     //                                    .data.a.addr = service.address_ipv4,
     //                                    .rclass = 0,
     //                                    .ttl = 0};
-    mdns_record_t recordOut;
+    mdns_record_t recordOut{};
     recordOut.name = Convert(record.header.entry_string);
     recordOut.type = MDNS_RECORDTYPE_A;
-    // recordOut.data.a.addr = Convert(record.address_string);
+    recordOut.data.a.addr = ParseIPV4Address(record.address_string);
 
     recordOut.rclass = record.header.rclass;
     recordOut.ttl = record.header.ttl;
@@ -83,10 +190,10 @@ inline mdns_record_t Convert(const AAAARecord& record)
     //                                    .data.a.addr = service.address_ipv4,
     //                                    .rclass = 0,
     //                                    .ttl = 0};
-    mdns_record_t recordOut;
+    mdns_record_t recordOut{};
     recordOut.name = Convert(record.header.entry_string);
     recordOut.type = MDNS_RECORDTYPE_AAAA;
-    // recordOut.data.a.addr = service.address;
+    recordOut.data.aaaa.addr = ParseIPV6Address(record.address_string);
 
     recordOut.rclass = record.header.rclass;
     recordOut.ttl = record.header.ttl;
@@ -105,21 +212,25 @@ inline std::vector<mdns_record_t> Convert(const TXTRecord& recordIn)
     //                                         .ttl = 0};
     std::vector<mdns_record_t> recordsOut;
     if (recordIn.txt.empty()) {
-        mdns_record_t rec;
+        mdns_record_t rec{};
         rec.name = Convert(recordIn.header.entry_string);
         rec.type = MDNS_RECORDTYPE_TXT;
         rec.rclass = recordIn.header.rclass;
         rec.ttl = recordIn.header.ttl;
         recordsOut.push_back(rec);
     } else {
-        for (const auto& txtpair : recordIn.txt) {
-            mdns_record_t rec;
+        // key/value point into the TxtData buffer, recordIn must outlive the returned records
+        recordsOut.reserve(recordIn.txt.size());
+        for (const auto entry : recordIn.txt) {
+            mdns_record_t rec{};
             rec.name = Convert(recordIn.header.entry_string);
             rec.type = MDNS_RECORDTYPE_TXT;
-            rec.data.txt.key = Convert(txtpair.first);
-            rec.data.txt.value = Convert(txtpair.second);
+            rec.data.txt.key = Convert(entry.key);
+            // A null value is a boolean "key", an empty one "key=", see PacketWriter::WriteTxt()
+            rec.data.txt.value = entry.has_value ? Convert(entry.value) : mdns_string_t{nullptr, 0};
             rec.rclass = recordIn.header.rclass;
             rec.ttl = recordIn.header.ttl;
+            recordsOut.push_back(rec);
         }
     }
     
@@ -127,4 +238,45 @@ inline std::vector<mdns_record_t> Convert(const TXTRecord& recordIn)
 }
 
 
-}
\ No newline at end of file
+// mdns.h has no rdata layout for the types below, they borrow its unions instead: CNAME the PTR
+// name, HINFO the TXT key/value for its CPU and OS strings and NSEC the TXT key/value for its
+// next domain name and type bitmap. Only PacketWriter knows how to send them
+inline mdns_record_t Convert(const CNAMERecord& record)
+{
+    mdns_record_t recordOut{};
+    recordOut.name = Convert(record.header.entry_string);
+    recordOut.type = static_cast<mdns_record_type_t>(RecordType::CNAME);
+    recordOut.data.ptr.name = Convert(record.target);
+
+    recordOut.rclass = record.header.rclass;
+    recordOut.ttl = record.header.ttl;
+    return recordOut;
+}
+
+inline mdns_record_t Convert(const HINFORecord& record)
+{
+    mdns_record_t recordOut{};
+    recordOut.name = Convert(record.header.entry_string);
+    recordOut.type = static_cast<mdns_record_type_t>(RecordType::HINFO);
+    recordOut.data.txt.key = Convert(record.cpu);
+    recordOut.data.txt.value = Convert(record.os);
+
+    recordOut.rclass = record.header.rclass;
+    recordOut.ttl = record.header.ttl;
+    return recordOut;
+}
+
+inline mdns_record_t Convert(const NSECRecord& record)
+{
+    mdns_record_t recordOut{};
+    recordOut.name = Convert(record.header.entry_string);
+    recordOut.type = static_cast<mdns_record_type_t>(RecordType::NSEC);
+    recordOut.data.txt.key = Convert(record.next_domain);
+    recordOut.data.txt.value = Convert(record.types.Wire());
+
+    recordOut.rclass = record.header.rclass;
+    recordOut.ttl = record.header.ttl;
+    return recordOut;
+}
+
+}